@@ -0,0 +1,517 @@
+// crop_vid_bench: 用本地生成的 testsrc2 视频测量各阶段性能
+//
+// crop_vid_bench -dir path -res 720p,1080p,4k -boxes 1,10,50 -size 320x240,224x224
+//                -frames n -stage decode,crop,resize,encode,e2e -j threads -o report.jsonl
+//
+// 每个测量输出一行 json (JSON Lines)，字段:
+//   stage, input, boxes, target, backend, frames, seconds, fps,
+//   p50_us, p90_us, p99_us, max_us (每帧延时), peak_rss_kb (该测量期间的峰值 RSS)
+
+#include "media.hxx"
+#include "output.hxx"
+#include "pipeline.hxx"
+
+extern "C" {
+#   include <libavfilter/buffersink.h>
+}
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+struct BenchOpts {
+    std::string dir;                // 生成的视频和编码输出目录
+    std::vector<std::pair<int, int>> res;
+    std::vector<int> boxes;
+    std::vector<std::pair<int, int>> sizes;
+    int frames;                     // 每个测量的帧数，也是生成视频的长度
+    std::string stages;
+    int threads;                    // > 0 时 e2e 额外测量流水线
+    const char *report;             // 默认 stdout
+};
+
+/// 每帧延时统计
+class Stats {
+    std::vector<double> __us;
+    std::chrono::steady_clock::time_point __t0;
+
+public:
+    void start() { __t0 = std::chrono::steady_clock::now(); }
+    void stop() {
+        __us.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - __t0).count());
+    }
+
+    int count() const { return __us.size(); }
+    double total_us() const {
+        double s = 0;
+        for (double v: __us) s += v;
+        return s;
+    }
+    double percentile(double p) {
+        if (__us.empty()) return 0;
+        std::sort(__us.begin(), __us.end());
+        size_t i = std::min(__us.size() - 1, (size_t)(p * __us.size()));
+        return __us[i];
+    }
+};
+
+static FILE *_report = stdout;
+
+// 清除峰值 RSS，之后 peak_rss_kb() 只反映当前测量，不支持时返回进程的峰值
+static void reset_peak_rss() {
+    FILE *fp = fopen("/proc/self/clear_refs", "w");
+    if (fp) {
+        fputs("5", fp);
+        fclose(fp);
+    }
+}
+
+static long peak_rss_kb() {
+    FILE *fp = fopen("/proc/self/status", "r");
+    if (fp) {
+        char line[256];
+        long kb = -1;
+        while (fgets(line, sizeof(line), fp)) {
+            if (sscanf(line, "VmHWM: %ld", &kb) == 1) break;
+        }
+        fclose(fp);
+        if (kb >= 0) return kb;
+    }
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return ru.ru_maxrss;
+}
+
+// seconds 为 0 时使用 stats 的总时间
+static void report(const char *stage, int w, int h, int boxes, int tw, int th, const char *backend,
+        Stats *stats, int frames, double seconds) {
+    if (stats) {
+        frames = stats->count();
+        if (seconds <= 0) seconds = stats->total_us() / 1e6;
+    }
+    fprintf(_report, "{\"stage\":\"%s\",\"input\":\"%dx%d\",\"boxes\":%d,\"target\":\"%dx%d\",\"backend\":\"%s\","
+            "\"frames\":%d,\"seconds\":%.6f,\"fps\":%.2f",
+            stage, w, h, boxes, tw, th, backend, frames, seconds, seconds > 0 ? frames / seconds : 0.0);
+    if (stats) {
+        fprintf(_report, ",\"p50_us\":%.1f,\"p90_us\":%.1f,\"p99_us\":%.1f,\"max_us\":%.1f",
+                stats->percentile(0.5), stats->percentile(0.9), stats->percentile(0.99), stats->percentile(1.0));
+    }
+    fprintf(_report, ",\"peak_rss_kb\":%ld}\n", peak_rss_kb());
+    fflush(_report);
+}
+
+// 固定种子，每次生成相同的框
+static std::vector<Box> make_boxes(int n, int w, int h) {
+    std::vector<Box> boxes;
+    uint32_t seed = 12345;
+    auto rnd = [&seed](int m) {
+        seed = seed * 1103515245 + 12345;
+        return (int)((seed >> 8) % m);
+    };
+    for (int i = 0; i < n; i++) {
+        int bw = w / 8 + rnd(w / 8), bh = h / 4 + rnd(h / 4);
+        int x1 = rnd(w - bw) & ~1, y1 = rnd(h - bh) & ~1;
+        boxes.push_back({x1, y1, x1 + bw, y1 + bh, "person", 0.9});
+    }
+    return boxes;
+}
+
+// testsrc2 -> format -> buffersink，编码为 <dir>/testsrc2-WxH-N.mp4，已存在时直接使用
+static std::string gen_input(const BenchOpts &opts, int w, int h) {
+    char fname[512];
+    snprintf(fname, sizeof(fname), "%s/testsrc2-%dx%d-%d.mp4", opts.dir.c_str(), w, h, opts.frames);
+    struct stat st;
+    if (stat(fname, &st) == 0 && st.st_size > 0) {
+        return fname;
+    }
+
+    char buf[128];
+    AVFilterGraph *graph = avfilter_graph_alloc();
+    AVFilterContext *src = 0, *fmt = 0, *sink = 0;
+    snprintf(buf, sizeof(buf), "size=%dx%d:rate=25:duration=%.3f", w, h, opts.frames / 25.0);
+    int rc = avfilter_graph_create_filter(&src, avfilter_get_by_name("testsrc2"), "src", buf, 0, graph);
+    if (rc >= 0)
+        rc = avfilter_graph_create_filter(&fmt, avfilter_get_by_name("format"), "fmt", "pix_fmts=yuv420p", 0, graph);
+    if (rc >= 0)
+        rc = avfilter_graph_create_filter(&sink, avfilter_get_by_name("buffersink"), "sink", 0, 0, graph);
+    if (rc >= 0)
+        rc = avfilter_link(src, 0, fmt, 0);
+    if (rc >= 0)
+        rc = avfilter_link(fmt, 0, sink, 0);
+    if (rc >= 0)
+        rc = avfilter_graph_config(graph, 0);
+    if (rc < 0) {
+        fprintf(stderr, "ERR: %s:%d cannot create testsrc2 graph, rc=%d\n", __func__, __LINE__, rc);
+        avfilter_graph_free(&graph);
+        return "";
+    }
+
+    VideoEnc enc;
+    if (enc.open(fname, w, h, 25, w * h * 2) < 0) {
+        fprintf(stderr, "ERR: %s:%d cannot open %s\n", __func__, __LINE__, fname);
+        avfilter_graph_free(&graph);
+        return "";
+    }
+    AVFrame *frame = av_frame_alloc();
+    for (int i = 0; av_buffersink_get_frame(sink, frame) >= 0; i++) {
+        enc.put_frame(i / 25.0, frame);
+        av_frame_unref(frame);
+    }
+    enc.close();
+    av_frame_free(&frame);
+    avfilter_graph_free(&graph);
+    fprintf(stderr, "generated %s\n", fname);
+    return fname;
+}
+
+static int bench_decode(const BenchOpts &opts, const std::string &fname, int w, int h) {
+    VideoDec dec;
+    if (dec.open(fname.c_str()) < 0) {
+        return -1;
+    }
+    reset_peak_rss();
+    Stats stats;
+    for (;;) {
+        double stamp;
+        AVFrame *frame;
+        stats.start();
+        int rc = dec.get_frame(&stamp, &frame);
+        if (rc <= 0) break;
+        stats.stop();
+        av_frame_unref(frame);
+    }
+    report("decode", w, h, 0, 0, 0, "", &stats, 0, 0);
+    dec.close();
+    return 0;
+}
+
+// 解码前 n 帧缓存，crop/encode 测量不包含解码
+static std::vector<AVFrame *> cache_frames(const std::string &fname, int n) {
+    std::vector<AVFrame *> frames;
+    VideoDec dec;
+    if (dec.open(fname.c_str()) < 0) {
+        return frames;
+    }
+    double stamp;
+    AVFrame *frame;
+    while ((int)frames.size() < n && dec.get_frame(&stamp, &frame) > 0) {
+        frames.push_back(av_frame_clone(frame));
+        av_frame_unref(frame);
+    }
+    dec.close();
+    return frames;
+}
+
+static void free_frames(std::vector<AVFrame *> &frames) {
+    for (auto f: frames) av_frame_free(&f);
+    frames.clear();
+}
+
+static int bench_crop(const BenchOpts &opts, const std::vector<AVFrame *> &cache, int w, int h) {
+    const FrameCrop::Backend backends[] = { FrameCrop::FILTER, FrameCrop::NATIVE };
+    for (int n: opts.boxes) {
+        std::vector<Box> boxes = make_boxes(n, w, h);
+        for (auto &size: opts.sizes) {
+            for (auto backend: backends) {
+                FrameCrop cropper;
+                if (cropper.open(w, h, AV_PIX_FMT_YUV420P, boxes, size.first, size.second, backend) < 0) {
+                    cropper.close();
+                    continue;
+                }
+                reset_peak_rss();
+                Stats stats;
+                for (int i = 0; i < opts.frames; i++) {
+                    // filter 方式 put 会取走 frame 的引用，每次使用新的引用
+                    AVFrame *frame = av_frame_clone(cache[i % cache.size()]);
+                    stats.start();
+                    if (cropper.put(frame, i / 25.0) >= 0) {
+                        for (auto cf: cropper.get()) {
+                            if (cf) cropper.release(cf);
+                        }
+                    }
+                    stats.stop();
+                    av_frame_free(&frame);
+                }
+                report("crop", w, h, n, size.first, size.second, backend == FrameCrop::NATIVE ? "native" : "filter",
+                        &stats, 0, 0);
+                cropper.close();
+            }
+        }
+    }
+    return 0;
+}
+
+// native crop 的单平面缩放，双线性（源不到目标的 2 倍）和区域平均（2 倍以上）分开测量
+// 源为帧左上角的亮度区域: 双线性 1.5 倍、区域平均 3 倍目标大小，超出帧时裁剪
+static int bench_resize(const BenchOpts &opts, const std::vector<AVFrame *> &cache, int w, int h) {
+    for (auto &size: opts.sizes) {
+        int tw = size.first, th = size.second;
+        for (int k: { 3, 6 }) {
+            int sw = std::min(w, tw * k / 2), sh = std::min(h, th * k / 2);
+            PlaneResizer resizer;
+            if (resizer.init(sw, sh, tw, th) < 0) {
+                continue;
+            }
+            std::vector<uint8_t> dst(tw * th);
+            reset_peak_rss();
+            Stats stats;
+            for (int i = 0; i < opts.frames; i++) {
+                const AVFrame *f = cache[i % cache.size()];
+                stats.start();
+                resizer.resize(f->data[0], f->linesize[0], dst.data(), tw);
+                stats.stop();
+            }
+            std::string backend = std::string(resizer.area() ? "area-" : "bilinear-") + PlaneResizer::impl_name();
+            report("resize", sw, sh, 1, tw, th, backend.c_str(), &stats, 0, 0);
+        }
+    }
+    return 0;
+}
+
+static int bench_encode(const BenchOpts &opts, const std::vector<AVFrame *> &cache, int w, int h) {
+    std::vector<Box> boxes = make_boxes(1, w, h);
+    for (auto &size: opts.sizes) {
+        FrameCrop cropper;
+        if (cropper.open(w, h, AV_PIX_FMT_YUV420P, boxes, size.first, size.second, FrameCrop::NATIVE) < 0) {
+            cropper.close();
+            continue;
+        }
+        char fname[512];
+        snprintf(fname, sizeof(fname), "%s/enc-%dx%d.mp4", opts.dir.c_str(), size.first, size.second);
+        VideoEnc enc;
+        if (enc.open(fname, size.first, size.second) < 0) {
+            cropper.close();
+            continue;
+        }
+
+        reset_peak_rss();
+        Stats stats;
+        for (int i = 0; i < opts.frames; i++) {
+            AVFrame *frame = av_frame_clone(cache[i % cache.size()]);
+            if (cropper.put(frame, i / 25.0) >= 0) {
+                AVFrame *cf = cropper.get()[0];
+                if (cf) {
+                    stats.start();
+                    enc.put_frame(i / 25.0, cf);
+                    stats.stop();
+                    cropper.release(cf);
+                }
+            }
+            av_frame_free(&frame);
+        }
+        // flush 计入总时间，不计入每帧延时
+        auto t0 = std::chrono::steady_clock::now();
+        enc.close();
+        double flush = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+        report("encode", w, h, 1, size.first, size.second, "", &stats, 0, stats.total_us() / 1e6 + flush);
+        cropper.close();
+    }
+    return 0;
+}
+
+// 解码 -> crop -> 编码到文件，threads > 0 时同时测量流水线
+static int bench_e2e(const BenchOpts &opts, const std::string &fname, int w, int h) {
+    for (int n: opts.boxes) {
+        std::vector<Box> boxes = make_boxes(n, w, h);
+        for (auto &size: opts.sizes) {
+            for (int mode = 0; mode < (opts.threads > 0 ? 2 : 1); mode++) {
+                VideoDec dec;
+                FrameCrop cropper;
+                FileOutput out;
+                char prefix[512];
+                snprintf(prefix, sizeof(prefix), "%s/e2e-%dx%d", opts.dir.c_str(), size.first, size.second);
+                if (dec.open(fname.c_str()) < 0 ||
+                        cropper.open(w, h, AV_PIX_FMT_YUV420P, boxes, size.first, size.second, FrameCrop::NATIVE) < 0 ||
+                        out.open(boxes, prefix, size.first, size.second) < 0) {
+                    out.close();
+                    cropper.close();
+                    dec.close();
+                    return -1;
+                }
+
+                reset_peak_rss();
+                auto t0 = std::chrono::steady_clock::now();
+                double stamp;
+                AVFrame *frame;
+                int rc = dec.get_frame(&stamp, &frame);
+                if (mode == 0) {
+                    Stats stats;
+                    while (rc > 0) {
+                        stats.start();
+                        if (cropper.put(frame, stamp) >= 0) {
+                            const std::vector<AVFrame *> &cropped = cropper.get();
+                            for (int j = 0; j < cropped.size(); j++) {
+                                if (cropped[j]) {
+                                    out.put_frame(j, stamp, cropped[j]);
+                                    cropper.release(cropped[j]);
+                                }
+                            }
+                        }
+                        av_frame_unref(frame);
+                        rc = dec.get_frame(&stamp, &frame);
+                        stats.stop();
+                    }
+                    out.close();
+                    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+                    report("e2e", w, h, n, size.first, size.second, "native", &stats, 0, seconds);
+                }
+                else {
+                    int frames = 0;
+                    if (rc > 0) {
+                        RunStats stats(n, false);
+                        Pipeline pipeline(opts.threads, 16);
+                        frames = pipeline.run(&dec, &cropper, &out, &stats, frame, stamp, 1e9);
+                    }
+                    out.close();
+                    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+                    report("e2e_pipeline", w, h, n, size.first, size.second, "native", nullptr, frames, seconds);
+                }
+                cropper.close();
+                dec.close();
+            }
+        }
+    }
+    return 0;
+}
+
+static int parse_size(const char *s, std::pair<int, int> *size) {
+    if (strcmp(s, "720p") == 0) *size = { 1280, 720 };
+    else if (strcmp(s, "1080p") == 0) *size = { 1920, 1080 };
+    else if (strcmp(s, "4k") == 0) *size = { 3840, 2160 };
+    else if (sscanf(s, "%dx%d", &size->first, &size->second) != 2) return -1;
+    return 0;
+}
+
+// 逗号分隔的列表
+static std::vector<std::string> split(const char *s) {
+    std::vector<std::string> items;
+    std::string cur;
+    for (; ; s++) {
+        if (*s == ',' || *s == 0) {
+            if (!cur.empty()) items.push_back(cur);
+            cur.clear();
+            if (*s == 0) break;
+        }
+        else {
+            cur += *s;
+        }
+    }
+    return items;
+}
+
+static int parse_opts(int argc, char **argv, BenchOpts *opts) {
+    opts->dir = "/tmp/crop_vid_bench";
+    opts->res = { { 1280, 720 }, { 1920, 1080 }, { 3840, 2160 } };
+    opts->boxes = { 1, 10, 50 };
+    opts->sizes = { { 320, 240 } };
+    opts->frames = 250;
+    opts->stages = "decode,crop,resize,encode,e2e";
+    opts->threads = 0;
+    opts->report = 0;
+
+    for (int curr = 1; curr < argc; curr++) {
+        if (curr + 1 >= argc) {
+            fprintf(stderr, "ERR: %s:%d no value for %s\n", __func__, __LINE__, argv[curr]);
+            return -1;
+        }
+        const char *v = argv[++curr];
+        const char *opt = argv[curr-1];
+        if (strcmp(opt, "-dir") == 0) {
+            opts->dir = v;
+        }
+        else if (strcmp(opt, "-res") == 0 || strcmp(opt, "-size") == 0) {
+            auto &list = strcmp(opt, "-res") == 0 ? opts->res : opts->sizes;
+            list.clear();
+            for (auto &s: split(v)) {
+                std::pair<int, int> size;
+                if (parse_size(s.c_str(), &size) < 0) {
+                    fprintf(stderr, "ERR: %s:%d invalid size: %s\n", __func__, __LINE__, s.c_str());
+                    return -1;
+                }
+                list.push_back(size);
+            }
+        }
+        else if (strcmp(opt, "-boxes") == 0) {
+            opts->boxes.clear();
+            for (auto &s: split(v)) opts->boxes.push_back(atoi(s.c_str()));
+        }
+        else if (strcmp(opt, "-frames") == 0) {
+            opts->frames = atoi(v);
+        }
+        else if (strcmp(opt, "-stage") == 0) {
+            opts->stages = v;
+        }
+        else if (strcmp(opt, "-j") == 0) {
+            opts->threads = atoi(v);
+        }
+        else if (strcmp(opt, "-o") == 0) {
+            opts->report = v;
+        }
+        else {
+            fprintf(stderr, "ERR: %s:%d unknown opt: %s\n", __func__, __LINE__, opt);
+            return -1;
+        }
+    }
+    if (opts->frames <= 0) {
+        fprintf(stderr, "ERR: %s:%d invalid frames: %d\n", __func__, __LINE__, opts->frames);
+        return -1;
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    BenchOpts opts;
+    if (parse_opts(argc, argv, &opts) < 0) {
+        return -1;
+    }
+    mkdir(opts.dir.c_str(), 0755);
+    if (opts.report) {
+        _report = fopen(opts.report, "w");
+        if (!_report) {
+            fprintf(stderr, "ERR: %s:%d cannot open %s\n", __func__, __LINE__, opts.report);
+            return -1;
+        }
+    }
+    av_log_set_level(AV_LOG_ERROR);
+    fprintf(stderr, "resize impl: %s\n", PlaneResizer::impl_name());
+
+    auto stages = split(opts.stages.c_str());
+    auto has = [&stages](const char *s) { return std::find(stages.begin(), stages.end(), s) != stages.end(); };
+
+    for (auto &res: opts.res) {
+        int w = res.first, h = res.second;
+        std::string fname = gen_input(opts, w, h);
+        if (fname.empty()) {
+            return -1;
+        }
+
+        if (has("decode")) {
+            bench_decode(opts, fname, w, h);
+        }
+        if (has("crop") || has("resize") || has("encode")) {
+            std::vector<AVFrame *> cache = cache_frames(fname, std::min(opts.frames, 16));
+            if (cache.empty()) {
+                fprintf(stderr, "ERR: %s:%d cannot decode %s\n", __func__, __LINE__, fname.c_str());
+                return -1;
+            }
+            if (has("crop")) bench_crop(opts, cache, w, h);
+            if (has("resize")) bench_resize(opts, cache, w, h);
+            if (has("encode")) bench_encode(opts, cache, w, h);
+            free_frames(cache);
+        }
+        if (has("e2e")) {
+            bench_e2e(opts, fname, w, h);
+        }
+    }
+
+    if (_report != stdout) {
+        fclose(_report);
+    }
+    return 0;
+}
@@ -0,0 +1,110 @@
+#ifndef _cropvid_h
+#define _cropvid_h
+
+/// libcropvid: 进程内调用的 crop 接口
+/// 输入为文件、内存、mmap 文件或读回调，输出为每个框的 h264 packet 或 YUV420P 帧回调，不写临时文件
+///
+///     cropvid_params p;
+///     cropvid_default_params(&p);
+///     cropvid_t *h = cropvid_open_memory(data, size, &p);
+///     cropvid_set_boxes(h, boxes, n);
+///     cropvid_set_packet_callback(h, on_packet, ctx);
+///     int rc = cropvid_run(h);
+///     cropvid_close(h);
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define CROPVID_VERSION "1.0.0"
+
+/// seek 回调 whence 为该值时返回输入总字节数，未知时返回 < 0
+#define CROPVID_SEEK_SIZE 0x10000
+
+typedef struct cropvid_t cropvid_t;
+
+typedef struct cropvid_params {
+    double from;            // 起始时间戳，默认 0
+    double duration;        // 持续时间，默认 1e9 到输入结束
+    int width, height;      // 输出大小，默认 320 x 240
+    double fps;             // 输出帧率，默认 0 保持输入帧率
+    int bitrate;            // packet 输出的码率，默认 50000
+    int max_boxes;          // 按 score 取前 N 个框，默认 0 不限制
+    float nms_iou;          // 默认 0.7，0 不去重
+    float share_iou;        // 默认 0.9，0 不共用 crop
+    double ext_left, ext_right, ext_top;    // 框扩展比例，默认 0.3 0.3 0.2
+    int threads;            // 编码线程数，默认 0 在 cropvid_run 的线程中执行
+    int dec_threads;        // 解码线程数，默认 0 自动
+    int native_crop;        // 1: 使用 native crop，默认 0 使用 avfilter
+    int debug;              // 1: 输出过程信息和进度到 stdout/stderr，默认 0 只输出错误和警告
+} cropvid_params;
+
+/// 检测框，坐标为输入图像像素，cls 为动作类别
+typedef struct cropvid_box {
+    int x1, y1, x2, y2;
+    int cls;
+    double score;
+} cropvid_box;
+
+/// 编码后的 h264 packet（Annex B），pts/dts 时间基为 1/90000，0 对应第一帧
+typedef struct cropvid_packet {
+    int box;                // 输出框序号，见 cropvid_output_boxes
+    const uint8_t *data;
+    int size;
+    int64_t pts, dts;
+    int key;                // 关键帧，包含 SPS/PPS
+    double stamp;           // pts 对应的输入时间戳，秒
+} cropvid_packet;
+
+/// crop 后的 YUV420P 帧
+typedef struct cropvid_frame {
+    int box;
+    double stamp;
+    int width, height;
+    const uint8_t *data[3];
+    int linesize[3];
+} cropvid_frame;
+
+/// 返回读取的字节数，0 为结束，< 0 为错误
+typedef int (*cropvid_read_cb)(void *opaque, uint8_t *buf, int size);
+/// whence 为 SEEK_SET/SEEK_CUR/SEEK_END/CROPVID_SEEK_SIZE，返回新位置，< 0 为错误
+typedef int64_t (*cropvid_seek_cb)(void *opaque, int64_t offset, int whence);
+
+/// 回调中的数据只在调用期间有效；返回 < 0 时该帧计为失败
+/// threads > 0 时不同框的回调可能在不同线程中同时调用，同一个框按时间顺序调用
+typedef int (*cropvid_packet_cb)(void *opaque, const cropvid_packet *pkt);
+typedef int (*cropvid_frame_cb)(void *opaque, const cropvid_frame *frame);
+
+const char *cropvid_version(void);
+void cropvid_default_params(cropvid_params *params);
+
+/// 打开输入，失败返回 NULL；params 为 NULL 时使用默认参数
+cropvid_t *cropvid_open_file(const char *fname, const cropvid_params *params);
+/// seek 为 NULL 时输入不可 seek，from 之前的帧解码后丢弃
+cropvid_t *cropvid_open_io(cropvid_read_cb read, cropvid_seek_cb seek, void *opaque, const cropvid_params *params);
+/// data 在 cropvid_close 之前必须有效
+cropvid_t *cropvid_open_memory(const uint8_t *data, size_t size, const cropvid_params *params);
+/// mmap 整个文件，按内存输入处理
+cropvid_t *cropvid_open_mapped(const char *fname, const cropvid_params *params);
+
+/// 设置检测框，会按 ext_* 扩展，再裁剪到图像内、去重、取前 max_boxes 个
+int cropvid_set_boxes(cropvid_t *h, const cropvid_box *boxes, int n);
+/// 两种输出二选一，后设置的生效
+int cropvid_set_packet_callback(cropvid_t *h, cropvid_packet_cb cb, void *opaque);
+int cropvid_set_frame_callback(cropvid_t *h, cropvid_frame_cb cb, void *opaque);
+
+/// 执行 crop，返回 0 成功，1 没有框，< 0 失败；可多次调用，读回调输入从当前位置继续
+int cropvid_run(cropvid_t *h);
+/// 实际输出的框（扩展、裁剪、去重之后），第一个回调之前确定；返回框数
+int cropvid_output_boxes(cropvid_t *h, const cropvid_box **boxes);
+
+void cropvid_close(cropvid_t *h);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // cropvid.h
@@ -0,0 +1,141 @@
+#include "batch.hxx"
+#include "chunk.hxx"
+
+#include <stdio.h>
+#include <string.h>
+#include <thread>
+
+int Batch::load(const char *fname, const Opts &base) {
+    FILE *fp = fopen(fname, "r");
+    if (!fp) {
+        fprintf(stderr, "ERR: %s:%d cannot open batch file: %s\n", __func__, __LINE__, fname);
+        return -1;
+    }
+
+    char line[4096];
+    int lineno = 0;
+    while (fgets(line, sizeof(line), fp)) {
+        lineno++;
+        char inp[1024], box[1024], prefix[1024];
+        double from = base.from, duration = base.duration;
+        prefix[0] = 0;
+
+        char *p = line;
+        while (*p == ' ' || *p == '\t') p++;
+        if (*p == '#' || *p == '\n' || *p == '\r' || *p == 0) {
+            continue;
+        }
+
+        int rc = sscanf(p, "%1023s %1023s %lf %lf %1023s", inp, box, &from, &duration, prefix);
+        if (rc < 2) {
+            fprintf(stderr, "WARN: %s:%d invalid line #%d in %s\n", __func__, __LINE__, lineno, fname);
+            continue;
+        }
+
+        Job job;
+        job.opts = base;
+        job.opts.inp_fname = inp;
+        job.opts.from = from;
+        job.opts.duration = duration;
+        job.opts.progress = 0;
+        if (prefix[0]) {
+            job.opts.out_prefix = prefix;
+        }
+        else {
+            // 默认使用任务序号区分输出
+            snprintf(prefix, sizeof(prefix), "%s%03d", base.out_prefix.c_str(), (int)__jobs.size());
+            job.opts.out_prefix = prefix;
+        }
+        if (base.shm_name) {
+            // 同时执行的任务不能使用同一个共享内存
+            char name[1024];
+            snprintf(name, sizeof(name), "%s-%03d", base.shm_name, (int)__jobs.size());
+            job.shm_name = name;
+        }
+        job.box_fname = strcmp(box, "-") == 0 ? (base.box_fname ? base.box_fname : "") : box;
+        __jobs.push_back(job);
+    }
+    fclose(fp);
+
+    fprintf(stdout, "DEBUG: %d jobs from %s\n", (int)__jobs.size(), fname);
+    return __jobs.size();
+}
+
+void share_threads(Opts *opts, int share) {
+    if (opts->threads > 0) {
+        // 流水线还有一个 crop 线程，剩下的解码和编码各占一半
+        int rest = share - 1;
+        int dec = rest / 2 > 0 ? rest / 2 : 1;
+        int enc = rest - dec > 0 ? rest - dec : 1;
+        if (opts->dec.threads <= 0 || opts->dec.threads > dec) opts->dec.threads = dec;
+        if (opts->threads > enc) opts->threads = enc;
+    }
+    else if (opts->dec.threads <= 0 || opts->dec.threads > share) {
+        opts->dec.threads = share;
+    }
+}
+
+int Batch::run(int budget, int concurrent) {
+    if (__jobs.empty()) {
+        return 0;
+    }
+    if (budget <= 0) {
+        budget = std::thread::hardware_concurrency();
+        if (budget <= 0) budget = 1;
+    }
+    if (concurrent <= 0) {
+        // 解码本身可以多线程，每个任务至少分到 2 个线程；-j 流水线还要 -j 个编码线程和一个 crop 线程
+        // -chunks 时每段都是这么多
+        int need = 2;
+        for (auto &job: __jobs) {
+            int n = (job.opts.threads > 0 ? job.opts.threads + 2 : 2) * (job.opts.chunks > 1 ? job.opts.chunks : 1);
+            if (n > need) need = n;
+        }
+        concurrent = budget / need > 0 ? budget / need : 1;
+    }
+    if (concurrent > __jobs.size()) {
+        concurrent = __jobs.size();
+    }
+
+    // 每个任务分到的线程数
+    int share = budget / concurrent > 0 ? budget / concurrent : 1;
+    for (auto &job: __jobs) {
+        share_threads(&job.opts, share);
+        // -chunks 在任务自己的份额内再分，不能按全局预算
+        job.opts.budget = share;
+    }
+
+    fprintf(stdout, "DEBUG: run %d jobs, budget %d threads, %d concurrent\n",
+            (int)__jobs.size(), budget, concurrent);
+
+    std::atomic<int> next(0), failed(0);
+    std::vector<std::thread> workers;
+    for (int i = 0; i < concurrent; i++) {
+        workers.emplace_back(&Batch::__worker, this, &next, &failed);
+    }
+    for (auto &th: workers) {
+        th.join();
+    }
+
+    fprintf(stdout, "DEBUG: batch done, %d jobs, %d failed\n", (int)__jobs.size(), failed.load());
+    return failed.load();
+}
+
+void Batch::__worker(std::atomic<int> *next, std::atomic<int> *failed) {
+    int i;
+    while ((i = next->fetch_add(1)) < __jobs.size()) {
+        Job &job = __jobs[i];
+        job.opts.box_fname = job.box_fname.empty() ? nullptr : job.box_fname.c_str();
+        if (!job.shm_name.empty()) {
+            job.opts.shm_name = job.shm_name.c_str();
+        }
+
+        fprintf(stdout, "DEBUG: job #%d begin: %s\n", i, job.opts.inp_fname.c_str());
+        int rc = run_chunked(job.opts);
+        if (rc != 0) {
+            fprintf(stderr, "ERR: %s:%d job #%d %s failed, rc=%d\n", __func__, __LINE__, i,
+                    job.opts.inp_fname.c_str(), rc);
+            failed->fetch_add(1);
+        }
+    }
+}
@@ -0,0 +1,35 @@
+#ifndef _batch_hh
+#define _batch_hh
+
+#include "job.hxx"
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+/// 批处理: 一个进程内执行任务清单中的所有任务，共享 libav 初始化和线程预算
+/// 清单每行一个任务: 视频 框文件 [from] [duration] [输出前缀]，# 开头为注释，
+/// 框文件为 - 时使用命令行中的 -b；-shm 时每个任务的共享内存名字为 <name>-<任务序号>
+class Batch {
+    struct Job {
+        Opts opts;
+        std::string box_fname;
+        std::string shm_name;   // 每个任务自己的共享内存名字
+    };
+    std::vector<Job> __jobs;
+
+public:
+    int load(const char *fname, const Opts &base);
+
+    // budget: 总线程数，concurrent: 同时执行的任务数，0 根据 budget 决定
+    // 返回失败的任务数
+    int run(int budget, int concurrent);
+
+private:
+    void __worker(std::atomic<int> *next, std::atomic<int> *failed);
+};
+
+/// 按分到的线程数 share 限制任务的解码/编码线程，流水线模式下去掉 crop 线程后解码和编码各占一半
+void share_threads(Opts *opts, int share);
+
+#endif // batch.hxx
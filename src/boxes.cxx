@@ -0,0 +1,99 @@
+#include "boxes.hxx"
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <numeric>
+
+float box_iou(const Box &a, const Box &b) {
+    int x1 = std::max(a.x1, b.x1), y1 = std::max(a.y1, b.y1);
+    int x2 = std::min(a.x2, b.x2), y2 = std::min(a.y2, b.y2);
+    if (x2 <= x1 || y2 <= y1) {
+        return 0.0f;
+    }
+    double inter = (double)(x2 - x1) * (y2 - y1);
+    double area_a = (double)(a.x2 - a.x1) * (a.y2 - a.y1), area_b = (double)(b.x2 - b.x1) * (b.y2 - b.y1);
+    return (float)(inter / (area_a + area_b - inter));
+}
+
+std::vector<Box> clamp_boxes(const std::vector<Box> &boxes, int w, int h) {
+    std::vector<Box> out;
+    for (const auto &b: boxes) {
+        Box box = b;
+        box.x1 = std::max(0, std::min(box.x1, w));
+        box.x2 = std::max(0, std::min(box.x2, w));
+        box.y1 = std::max(0, std::min(box.y1, h));
+        box.y2 = std::max(0, std::min(box.y2, h));
+        if (box.x2 - box.x1 < 4 || box.y2 - box.y1 < 4) {
+            fprintf(stderr, "WARN: %s:%d box out of frame: %d,%d,%d,%d\n", __func__, __LINE__,
+                    b.x1, b.y1, b.x2, b.y2);
+            continue;
+        }
+        out.push_back(box);
+    }
+    return out;
+}
+
+static bool same_title(const Box &a, const Box &b) {
+    return a.title == b.title || (a.title && b.title && strcmp(a.title, b.title) == 0);
+}
+
+std::vector<Box> nms_boxes(const std::vector<Box> &boxes, float iou, int top_k, float share_iou) {
+    std::vector<int> order(boxes.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&boxes](int a, int b) {
+        return boxes[a].score > boxes[b].score;
+    });
+
+    std::vector<int> keep;
+    for (int i: order) {
+        if (top_k > 0 && keep.size() >= top_k) {
+            break;
+        }
+        bool dup = false;
+        for (int k: keep) {
+            if (iou <= 0) {
+                break;
+            }
+            // 几乎相同、但动作类别不同的框都保留，之后共用 crop；类别相同的是重复检测，
+            // 保留下来也会输出到同一个文件名
+            float v = box_iou(boxes[i], boxes[k]);
+            bool share = share_iou > 0 && v >= share_iou && !same_title(boxes[i], boxes[k]);
+            if (v > iou && !share) {
+                dup = true;
+                break;
+            }
+        }
+        if (!dup) {
+            keep.push_back(i);
+        }
+    }
+
+    // 输出文件名和 lane 依赖框的顺序，保持原来的顺序
+    std::sort(keep.begin(), keep.end());
+    std::vector<Box> out;
+    for (int i: keep) {
+        out.push_back(boxes[i]);
+    }
+    return out;
+}
+
+std::vector<int> share_regions(const std::vector<Box> &boxes, float iou, std::vector<Box> &regions) {
+    regions.clear();
+    std::vector<int> region_of;
+    for (const auto &box: boxes) {
+        int r = -1;
+        for (int i = 0; iou > 0 && i < regions.size(); i++) {
+            if (box_iou(box, regions[i]) >= iou) {
+                r = i;
+                break;
+            }
+        }
+        if (r < 0) {
+            r = regions.size();
+            regions.push_back(box);
+        }
+        region_of.push_back(r);
+    }
+    return region_of;
+}
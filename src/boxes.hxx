@@ -0,0 +1,24 @@
+#ifndef _box_utils_hh
+#define _box_utils_hh
+
+#include "media.hxx"
+
+#include <vector>
+
+/// 框的后处理: 裁剪到图像内、NMS 去重、top-K、合并几乎相同的 crop 区域
+
+float box_iou(const Box &a, const Box &b);
+
+// 裁剪到 w x h 图像内，丢弃裁剪后小于 4x4 的框
+std::vector<Box> clamp_boxes(const std::vector<Box> &boxes, int w, int h);
+
+// 按 score 从大到小，与已保留的框 IoU > iou 的丢弃（不区分 cls），iou <= 0 不去重
+// IoU >= share_iou (> 0) 且 title 不同的框不丢弃，之后由 share_regions 共用 crop 区域
+// 最多保留 top_k 个，top_k <= 0 不限制；保留的框按原来的顺序返回
+std::vector<Box> nms_boxes(const std::vector<Box> &boxes, float iou, int top_k, float share_iou = 0);
+
+// IoU >= iou 的框共用一个 crop 区域，regions 为实际 crop 的区域（取第一个框）
+// 返回每个框对应的区域下标，iou <= 0 时每个框一个区域
+std::vector<int> share_regions(const std::vector<Box> &boxes, float iou, std::vector<Box> &regions);
+
+#endif // boxes.hxx
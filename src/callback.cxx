@@ -0,0 +1,71 @@
+#include "callback.hxx"
+
+#include <stdio.h>
+
+//////////////////////// packet
+int PacketOutput::open(const std::vector<Box> &boxes, int width, int height, double fps, int bitrate,
+        Callback cb) {
+    __cb = cb;
+    for (int i = 0; i < boxes.size(); i++) {
+        auto enc = new VideoEnc;
+        // 编码器只在自己的 lane 中使用，origin 在第一帧之后不再变化
+        auto sink = [this, i, enc](AVPacket *pkt) {
+            return __cb(i, enc->origin() + pkt->pts / 90000.0, pkt);
+        };
+        if (enc->open(sink, width, height, fps, bitrate) < 0) {
+            fprintf(stderr, "ERR: %s:%d cannot open encoder for box %d\n", __func__, __LINE__, i);
+            delete enc;
+            close();
+            return -1;
+        }
+        __encoders.push_back(enc);
+    }
+    return 0;
+}
+
+void PacketOutput::set_origin(double stamp) {
+    for (auto enc: __encoders) {
+        enc->set_origin(stamp);
+    }
+}
+
+int PacketOutput::put_frame(int box, double stamp, AVFrame *frame) {
+    return __encoders[box]->put_frame(stamp, frame);
+}
+
+int PacketOutput::close() {
+    for (auto enc: __encoders) {
+        enc->close();
+        __bytes.push_back(enc->bytes());
+        delete enc;
+    }
+    __encoders.clear();
+    return 0;
+}
+
+int64_t PacketOutput::bytes(int box) const {
+    if (!__encoders.empty()) {
+        int64_t sum = 0;
+        for (int i = 0; i < __encoders.size(); i++) {
+            if (box < 0 || box == i) sum += __encoders[i]->bytes();
+        }
+        return sum;
+    }
+    if (box >= 0) {
+        return box < __bytes.size() ? __bytes[box] : 0;
+    }
+    int64_t sum = 0;
+    for (auto b: __bytes) sum += b;
+    return sum;
+}
+
+//////////////////////// frame
+int FrameOutput::open(const std::vector<Box> &boxes, Callback cb) {
+    __boxes = boxes.size();
+    __cb = cb;
+    return 0;
+}
+
+int FrameOutput::put_frame(int box, double stamp, AVFrame *frame) {
+    return __cb(box, stamp, frame);
+}
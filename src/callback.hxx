@@ -0,0 +1,53 @@
+#ifndef _callback_output_hh
+#define _callback_output_hh
+
+#include "output.hxx"
+
+#include <functional>
+
+/// 不写文件，每个框编码后的 h264 packet 交给回调，每个框一个 lane
+/// 使用流水线时不同框的回调可能在不同线程中同时调用，同一个框按时间顺序调用
+class PacketOutput : public CropOutput {
+public:
+    // pkt 的时间基为 1/90000，stamp 为 pkt->pts 对应的输入时间戳；pkt 只在调用期间有效
+    typedef std::function<int(int box, double stamp, AVPacket *pkt)> Callback;
+
+private:
+    std::vector<VideoEnc *> __encoders;
+    std::vector<int64_t> __bytes;   // close() 时保存
+    Callback __cb;
+
+public:
+    int open(const std::vector<Box> &boxes, int width, int height, double fps, int bitrate, Callback cb);
+
+    int lanes() const override { return __encoders.size(); }
+    int lane(int box) const override { return box; }
+
+    int put_frame(int box, double stamp, AVFrame *frame) override;
+    int close() override;
+
+    int64_t bytes(int box) const override;
+    void set_origin(double stamp) override;
+};
+
+/// 不编码，crop 后的 YUV420P 帧交给回调，每个框一个 lane，线程约定同 PacketOutput
+class FrameOutput : public CropOutput {
+public:
+    // frame 只在调用期间有效，需要保存时使用 av_frame_ref 或复制
+    typedef std::function<int(int box, double stamp, AVFrame *frame)> Callback;
+
+private:
+    int __boxes = 0;
+    Callback __cb;
+
+public:
+    int open(const std::vector<Box> &boxes, Callback cb);
+
+    int lanes() const override { return __boxes; }
+    int lane(int box) const override { return box; }
+
+    int put_frame(int box, double stamp, AVFrame *frame) override;
+    int close() override { return 0; }
+};
+
+#endif // callback.hxx
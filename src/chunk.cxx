@@ -0,0 +1,346 @@
+#include "chunk.hxx"
+#include "batch.hxx"
+#include "index.hxx"
+#include "stats.hxx"
+
+#include <stdio.h>
+#include <math.h>
+#include <unistd.h>
+#include <mutex>
+#include <thread>
+
+// 分段边界，尽量靠近均分点的关键帧；没有索引时均分，seek 之后丢弃边界之前的帧，结果仍然正确
+static std::vector<double> split_points(const Opts &opts, const KeyIndex &index, double end) {
+    std::vector<double> keys;
+    const KeyIndex::Stream &s = index.stream();
+    for (const auto &e: index.entries()) {
+        double t = 1.0 * e.pts * s.time_base.num / s.time_base.den;
+        if (t > opts.from && t < end) {
+            keys.push_back(t);
+        }
+    }
+
+    std::vector<double> points = { opts.from };
+    for (int k = 1; k < opts.chunks; k++) {
+        double target = opts.from + (end - opts.from) * k / opts.chunks, best = target;
+        if (!keys.empty()) {
+            best = keys[0];
+            for (double t: keys) {
+                if (fabs(t - target) < fabs(best - target)) best = t;
+            }
+        }
+        // 关键帧太稀疏时可能少于 chunks 段
+        if (best > points.back() + 0.001) {
+            points.push_back(best);
+        }
+    }
+    points.push_back(end);
+    return points;
+}
+
+/// 合并各段的运行报告: {"input":..., "chunks":[{"from":..,"to":..,"rc":..,"report":{...}}, ...]}
+/// 写入 <out_prefix>-report.json（opts.report 时），有 on_report 时同时交给调用者
+static void save_chunk_report(const Opts &opts, const std::vector<double> &points, const std::vector<int> &rcs,
+        const std::vector<std::string> &reports) {
+    std::string json = "{\"input\":\"" + json_escape(opts.inp_fname) + "\",\"from\":" + std::to_string(opts.from) +
+        ",\"duration\":" + std::to_string(opts.duration) + ",\"chunks\":[\n";
+    for (int k = 0; k < reports.size(); k++) {
+        char head[128];
+        snprintf(head, sizeof(head), "%s{\"from\":%.3f,\"to\":%.3f,\"rc\":%d,\"report\":", k ? ",\n" : "",
+                points[k], points[k+1], rcs[k]);
+        std::string r = reports[k];
+        while (!r.empty() && r.back() == '\n') r.pop_back();
+        json += head + (r.empty() ? std::string("null") : r) + "}";
+    }
+    json += "]}\n";
+
+    if (opts.on_report) {
+        opts.on_report(json);
+    }
+    if (!opts.report) {
+        return;
+    }
+    std::string fname = opts.out_prefix + "-report.json";
+    FILE *fp = fopen(fname.c_str(), "w");
+    if (!fp) {
+        fprintf(stderr, "ERR: %s:%d cannot open report: %s\n", __func__, __LINE__, fname.c_str());
+        return;
+    }
+    fwrite(json.data(), 1, json.size(), fp);
+    fclose(fp);
+}
+
+int run_chunked(const Opts &opts) {
+    if (opts.chunks <= 1 || opts.tensor || opts.shm_name || opts.dec.follow > 0 || opts.dec.io || opts.make_output ||
+            opts.segment > 0 || opts.mux || !opts.windows.empty()) {
+        // 张量、共享内存、分段和调用者提供的输出不是单个视频文件，多流容器不是单路视频，不能拼接；
+        // 写入中的文件和自定义输入不能分段；多窗口本身就是一次解码
+        if (opts.chunks > 1) {
+            fprintf(stderr, "WARN: %s:%d -chunks only supports video outputs of finished files, run as one chunk\n",
+                    __func__, __LINE__);
+        }
+        return run_job(opts);
+    }
+
+    const char *fname = opts.inp_fname.c_str();
+    KeyIndex index;
+    if (index.load(fname) < 0 && index.build(fname) == 0 && opts.dec.index) {
+        // 各段打开输入时直接使用
+        index.save();
+    }
+
+    // 超出文件长度的段没有帧，会被当作失败
+    double end = opts.from + opts.duration, total = -1.0;
+    const KeyIndex::Stream &s = index.stream();
+    if (s.duration > 0 && s.time_base.den > 0) {
+        total = 1.0 * s.duration * s.time_base.num / s.time_base.den;
+    }
+    else {
+        VideoDec dec;
+        if (dec.open(fname, opts.dec) == 0) {
+            total = dec.get_duration();
+        }
+        dec.close();
+    }
+    if (total > 0 && end > total) {
+        end = total;
+    }
+    if (end <= opts.from) {
+        fprintf(stderr, "ERR: %s:%d empty range: %.03f - %.03f\n", __func__, __LINE__, opts.from, end);
+        return -1;
+    }
+
+    std::vector<double> points = split_points(opts, index, end);
+    int chunks = points.size() - 1;
+
+    int budget = opts.budget > 0 ? opts.budget : std::thread::hardware_concurrency();
+    if (budget <= 0) budget = 1;
+    int share = budget / chunks > 0 ? budget / chunks : 1;
+
+    // 各段必须使用相同的框才能拼接，检测只在开头执行一次
+    std::vector<Box> detected;
+    if (opts.det.model && opts.boxes.empty() && !opts.track_fname) {
+        VideoDec dec;
+        int rc = dec.open(fname, opts.dec);
+        if (rc == 0) {
+            dec.seek(opts.from);
+            dec.set_rate(opts.fps);
+            rc = detect_boxes(opts, &dec, detected);
+        }
+        dec.close();
+        if (rc < 0) {
+            return -1;
+        }
+        if (detected.empty()) {
+            fprintf(stderr, "WARN: %s:%d no person detected from %s\n", __func__, __LINE__, fname);
+            return 1;
+        }
+    }
+
+    std::vector<std::string> reports(chunks);
+    // 调用者要进度时（守护进程）汇总各段: 帧数和帧率相加，时间戳为 from 加上各段已处理的时长
+    std::mutex progress_lock;
+    std::vector<int64_t> done_frames(chunks, 0);
+    std::vector<double> done_sec(chunks, 0.0), done_fps(chunks, 0.0);
+    int64_t last_progress = 0;
+    int64_t interval_ns = (int64_t)(opts.progress * 1e9);
+    std::vector<Opts> parts(chunks, opts);
+    for (int k = 0; k < chunks; k++) {
+        Opts &o = parts[k];
+        o.from = points[k];
+        o.duration = points[k+1] - points[k];
+        o.out_prefix = opts.out_prefix + ".part" + std::to_string(k);
+        o.stamp_origin = opts.from;
+        o.chunks = 1;
+        o.progress = 0;
+        if (opts.on_progress && opts.progress > 0) {
+            o.progress = opts.progress;
+            o.on_progress = [&, k](int64_t frames, double stamp, double fps) {
+                std::lock_guard<std::mutex> guard(progress_lock);
+                done_frames[k] = frames;
+                done_sec[k] = stamp - points[k];
+                done_fps[k] = fps;
+                int64_t now = now_ns();
+                if (now - last_progress < interval_ns) {
+                    return;
+                }
+                last_progress = now;
+                int64_t total_frames = 0;
+                double total_sec = 0.0, total_fps = 0.0;
+                for (int i = 0; i < chunks; i++) {
+                    total_frames += done_frames[i];
+                    total_sec += done_sec[i] > 0 ? done_sec[i] : 0.0;
+                    total_fps += done_fps[i];
+                }
+                opts.on_progress(total_frames, opts.from + total_sec, total_fps);
+            };
+        }
+        // 各段同时执行，内存预算平分
+        if (o.mem_budget > 0) {
+            o.mem_budget = opts.mem_budget / chunks > 0 ? opts.mem_budget / chunks : 1;
+        }
+        // 各段的报告先收集，结束后合并为一个
+        o.report = 0;
+        o.on_report = nullptr;
+        if (opts.report || opts.on_report) {
+            o.on_report = [&reports, k](const std::string &json) {
+                reports[k] = json;
+            };
+        }
+        if (k > 0) o.track_save = 0;
+        if (!detected.empty()) o.boxes = detected;
+        // 线程预算按段平分，和批处理相同
+        share_threads(&o, share);
+        if (opts.verbose) {
+            fprintf(stdout, "DEBUG: chunk #%d: %.03f - %.03f\n", k, points[k], points[k+1]);
+        }
+    }
+
+    std::vector<int> rcs(chunks);
+    std::vector<std::vector<std::string>> files(chunks);
+    std::vector<std::thread> threads;
+    for (int k = 0; k < chunks; k++) {
+        threads.emplace_back([&, k]() {
+            rcs[k] = run_job(parts[k], &files[k]);
+        });
+    }
+    for (auto &th: threads) {
+        th.join();
+    }
+
+    int rc = 0;
+    for (int k = 0; k < chunks; k++) {
+        if (rcs[k] < 0) {
+            fprintf(stderr, "ERR: %s:%d chunk #%d failed, rc=%d\n", __func__, __LINE__, k, rcs[k]);
+        }
+        if (rcs[k] != 0) {
+            if (rc == 0) rc = rcs[k];
+        }
+        else if (rc == 0 && files[k].size() != files[0].size()) {
+            fprintf(stderr, "ERR: %s:%d chunk #%d has %d outputs, expect %d\n", __func__, __LINE__, k,
+                    (int)files[k].size(), (int)files[0].size());
+            rc = -1;
+        }
+    }
+
+    // 最终文件名为第一段的文件名去掉 .part0，失败时不拼接
+    const std::string &prefix0 = parts[0].out_prefix;
+    for (int i = 0; rc == 0 && i < files[0].size(); i++) {
+        std::string out = opts.out_prefix + files[0][i].substr(prefix0.size());
+        std::vector<std::string> inputs;
+        for (int k = 0; k < chunks; k++) {
+            inputs.push_back(files[k][i]);
+        }
+        if (concat_videos(inputs, out.c_str(), opts.fragmented) < 0) {
+            rc = -1;
+            unlink(out.c_str());
+            continue;
+        }
+        // 拼图的 .tiles 各段相同，保留第一段
+        std::string tiles = inputs[0] + ".tiles";
+        rename(tiles.c_str(), (out + ".tiles").c_str());
+    }
+
+    // 成功和失败都删除各段的临时文件
+    for (int k = 0; k < chunks; k++) {
+        for (auto &f: files[k]) {
+            unlink((f + ".tiles").c_str());
+            unlink(f.c_str());
+        }
+    }
+
+    if (opts.report || opts.on_report) {
+        save_chunk_report(opts, points, rcs, reports);
+    }
+    return rc;
+}
+
+int concat_videos(const std::vector<std::string> &parts, const char *fname, bool fragmented) {
+    AVFormatContext *ofc = nullptr;
+    if (avformat_alloc_output_context2(&ofc, nullptr, nullptr, fname) < 0) {
+        fprintf(stderr, "ERR: %s:%d cannot create output: %s\n", __func__, __LINE__, fname);
+        return -1;
+    }
+
+    AVStream *os = nullptr;
+    AVPacket *pkt = av_packet_alloc();
+    int64_t last_dts = AV_NOPTS_VALUE;
+    int rc = 0;
+    for (const auto &part: parts) {
+        AVFormatContext *ifc = nullptr;
+        if (avformat_open_input(&ifc, part.c_str(), 0, 0) < 0 || avformat_find_stream_info(ifc, 0) < 0) {
+            fprintf(stderr, "ERR: %s:%d cannot open part: %s\n", __func__, __LINE__, part.c_str());
+            avformat_close_input(&ifc);
+            rc = -1;
+            break;
+        }
+        int sid = av_find_best_stream(ifc, AVMEDIA_TYPE_VIDEO, -1, -1, 0, 0);
+        if (sid < 0) {
+            fprintf(stderr, "ERR: %s:%d no video stream in %s\n", __func__, __LINE__, part.c_str());
+            avformat_close_input(&ifc);
+            rc = -1;
+            break;
+        }
+        AVStream *is = ifc->streams[sid];
+
+        if (!os) {
+            // 参数取第一段，各段编码器设置相同
+            os = avformat_new_stream(ofc, 0);
+            avcodec_parameters_copy(os->codecpar, is->codecpar);
+            os->codecpar->codec_tag = 0;
+            os->time_base = is->time_base;
+            AVDictionary *mux_opts = nullptr;
+            if (fragmented) {
+                av_dict_set(&mux_opts, "movflags", "frag_keyframe+empty_moov+default_base_moof", 0);
+                av_dict_set(&mux_opts, "flush_packets", "1", 0);
+            }
+            int r = avio_open(&ofc->pb, fname, AVIO_FLAG_WRITE);
+            if (r >= 0) {
+                r = avformat_write_header(ofc, &mux_opts);
+            }
+            av_dict_free(&mux_opts);
+            if (r < 0) {
+                fprintf(stderr, "ERR: %s:%d cannot write %s\n", __func__, __LINE__, fname);
+                avformat_close_input(&ifc);
+                avio_closep(&ofc->pb);
+                os = nullptr;
+                rc = -1;
+                break;
+            }
+        }
+        else if (is->codecpar->codec_id != os->codecpar->codec_id ||
+                is->codecpar->width != os->codecpar->width || is->codecpar->height != os->codecpar->height) {
+            fprintf(stderr, "ERR: %s:%d %s does not match the first part\n", __func__, __LINE__, part.c_str());
+            avformat_close_input(&ifc);
+            rc = -1;
+            break;
+        }
+
+        while (av_read_frame(ifc, pkt) >= 0) {
+            if (pkt->stream_index != sid) {
+                av_packet_unref(pkt);
+                continue;
+            }
+            av_packet_rescale_ts(pkt, is->time_base, os->time_base);
+            pkt->stream_index = 0;
+            pkt->pos = -1;
+            // 各段时间戳已经使用同一起点，只防止边界处 dts 不递增
+            if (last_dts != AV_NOPTS_VALUE && pkt->dts != AV_NOPTS_VALUE && pkt->dts <= last_dts) {
+                int64_t shift = last_dts + 1 - pkt->dts;
+                pkt->dts += shift;
+                if (pkt->pts != AV_NOPTS_VALUE) pkt->pts += shift;
+            }
+            if (pkt->dts != AV_NOPTS_VALUE) last_dts = pkt->dts;
+            av_interleaved_write_frame(ofc, pkt);
+        }
+        avformat_close_input(&ifc);
+    }
+
+    if (os && ofc->pb) {
+        av_write_trailer(ofc);
+        avio_closep(&ofc->pb);
+    }
+    av_packet_free(&pkt);
+    avformat_free_context(ofc);
+    return rc;
+}
@@ -0,0 +1,19 @@
+#ifndef _chunk_job_hh
+#define _chunk_job_hh
+
+#include "job.hxx"
+
+#include <string>
+#include <vector>
+
+/// 分段并行: [from, from + duration) 按关键帧分为 opts.chunks 段，每段独立的解码/crop/编码，
+/// 各自输出 <out_prefix>.part<k>-...，全部完成后每个框的各段无损拼接为 <out_prefix>-...
+/// 各段使用相同的时间戳起点，每段第一帧为 IDR，拼接只复制 packet
+/// 返回值同 run_job
+int run_chunked(const Opts &opts);
+
+// 按顺序复制各文件的视频 packet 到 fname，编码参数必须相同
+// fragmented: 输出 fragmented mp4，与各段编码时的 movflags 相同
+int concat_videos(const std::vector<std::string> &parts, const char *fname, bool fragmented = false);
+
+#endif // chunk.hxx
@@ -0,0 +1,319 @@
+#include "cropvid.h"
+#include "job.hxx"
+#include "callback.hxx"
+#include "track.hxx"
+
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+struct cropvid_t {
+    enum Source { FROM_FILE, FROM_IO, FROM_MEMORY, FROM_MAPPED } source;
+    Opts opts;
+    int bitrate;
+
+    // FROM_IO
+    cropvid_read_cb read = nullptr;
+    cropvid_seek_cb seek = nullptr;
+    void *opaque = nullptr;
+
+    // FROM_MEMORY/FROM_MAPPED
+    const uint8_t *data = nullptr;
+    size_t size = 0;
+    size_t pos = 0;
+
+    cropvid_packet_cb on_packet = nullptr;
+    cropvid_frame_cb on_frame = nullptr;
+    void *cb_opaque = nullptr;
+
+    std::vector<cropvid_box> out_boxes;
+};
+
+static int title_cls(const char *title) {
+    for (int c = 0; strcmp(cls_title(c), "none") != 0; c++) {
+        if (cls_title(c) == title) return c;
+    }
+    return -1;
+}
+
+//////////////////////// io
+static int mem_read(void *opaque, uint8_t *buf, int size) {
+    cropvid_t *h = (cropvid_t *)opaque;
+    size_t left = h->size - h->pos;
+    if (left == 0) return AVERROR_EOF;
+    if (size > left) size = left;
+    memcpy(buf, h->data + h->pos, size);
+    h->pos += size;
+    return size;
+}
+
+static int64_t mem_seek(void *opaque, int64_t offset, int whence) {
+    cropvid_t *h = (cropvid_t *)opaque;
+    if (whence & AVSEEK_SIZE) return h->size;
+    int64_t pos;
+    switch (whence & ~AVSEEK_FORCE) {
+    case SEEK_SET: pos = offset; break;
+    case SEEK_CUR: pos = h->pos + offset; break;
+    case SEEK_END: pos = h->size + offset; break;
+    default: return AVERROR(EINVAL);
+    }
+    if (pos < 0 || pos > h->size) return AVERROR(EINVAL);
+    h->pos = pos;
+    return pos;
+}
+
+static int user_read(void *opaque, uint8_t *buf, int size) {
+    cropvid_t *h = (cropvid_t *)opaque;
+    int n = h->read(h->opaque, buf, size);
+    return n > 0 ? n : n == 0 ? AVERROR_EOF : AVERROR(EIO);
+}
+
+static int64_t user_seek(void *opaque, int64_t offset, int whence) {
+    cropvid_t *h = (cropvid_t *)opaque;
+    int64_t rc = whence & AVSEEK_SIZE ? h->seek(h->opaque, 0, CROPVID_SEEK_SIZE) :
+        h->seek(h->opaque, offset, whence & ~AVSEEK_FORCE);
+    return rc < 0 ? AVERROR(EIO) : rc;
+}
+
+static AVIOContext *open_io(cropvid_t *h) {
+    const int size = 64 * 1024;
+    uint8_t *buf = (uint8_t *)av_malloc(size);
+    AVIOContext *io;
+    if (h->source == cropvid_t::FROM_IO) {
+        io = avio_alloc_context(buf, size, 0, h, user_read, 0, h->seek ? user_seek : 0);
+    }
+    else {
+        h->pos = 0;
+        io = avio_alloc_context(buf, size, 0, h, mem_read, 0, mem_seek);
+    }
+    if (!io) {
+        av_free(buf);
+    }
+    return io;
+}
+
+static void close_io(AVIOContext *io) {
+    if (io) {
+        av_freep(&io->buffer);
+        avio_context_free(&io);
+    }
+}
+
+//////////////////////// api
+const char *cropvid_version(void) {
+    return CROPVID_VERSION;
+}
+
+void cropvid_default_params(cropvid_params *p) {
+    memset(p, 0, sizeof(*p));
+    p->from = 0.0;
+    p->duration = 1e9;
+    p->width = 320;
+    p->height = 240;
+    p->bitrate = 50000;
+    p->nms_iou = 0.7f;
+    p->share_iou = 0.9f;
+    p->ext_left = 0.3;
+    p->ext_right = 0.3;
+    p->ext_top = 0.2;
+}
+
+static cropvid_t *create(cropvid_t::Source source, const char *name, const cropvid_params *params) {
+    cropvid_params p;
+    if (params) p = *params;
+    else cropvid_default_params(&p);
+
+    cropvid_t *h = new cropvid_t;
+    h->source = source;
+    init_opts(&h->opts);
+    Opts &o = h->opts;
+    o.inp_fname = name;
+    o.box_fname = 0;
+    o.from = p.from;
+    o.duration = p.duration;
+    o.target_width = p.width;
+    o.target_height = p.height;
+    o.fps = p.fps;
+    o.max_person_cnt = p.max_boxes;
+    o.nms_iou = p.nms_iou;
+    o.share_iou = p.share_iou;
+    o.ext_left = p.ext_left;
+    o.ext_right = p.ext_right;
+    o.ext_top = p.ext_top;
+    o.threads = p.threads;
+    o.dec.threads = p.dec_threads;
+    o.crop_backend = p.native_crop ? FrameCrop::NATIVE : FrameCrop::FILTER;
+    // 库内不输出过程信息和进度，debug 时输出
+    o.debug = p.debug;
+    o.verbose = p.debug;
+    o.progress = p.debug ? 1.0 : 0;
+    h->bitrate = p.bitrate;
+    return h;
+}
+
+cropvid_t *cropvid_open_file(const char *fname, const cropvid_params *params) {
+    if (access(fname, R_OK) < 0) {
+        fprintf(stderr, "ERR: %s:%d cannot read %s\n", __func__, __LINE__, fname);
+        return nullptr;
+    }
+    return create(cropvid_t::FROM_FILE, fname, params);
+}
+
+cropvid_t *cropvid_open_io(cropvid_read_cb read, cropvid_seek_cb seek, void *opaque, const cropvid_params *params) {
+    if (!read) return nullptr;
+    cropvid_t *h = create(cropvid_t::FROM_IO, "io", params);
+    h->read = read;
+    h->seek = seek;
+    h->opaque = opaque;
+    return h;
+}
+
+cropvid_t *cropvid_open_memory(const uint8_t *data, size_t size, const cropvid_params *params) {
+    if (!data || !size) return nullptr;
+    cropvid_t *h = create(cropvid_t::FROM_MEMORY, "memory", params);
+    h->data = data;
+    h->size = size;
+    return h;
+}
+
+cropvid_t *cropvid_open_mapped(const char *fname, const cropvid_params *params) {
+    int fd = open(fname, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "ERR: %s:%d cannot open %s\n", __func__, __LINE__, fname);
+        return nullptr;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0 || st.st_size == 0) {
+        fprintf(stderr, "ERR: %s:%d empty or unknown size: %s\n", __func__, __LINE__, fname);
+        close(fd);
+        return nullptr;
+    }
+    void *ptr = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (ptr == MAP_FAILED) {
+        fprintf(stderr, "ERR: %s:%d mmap %s failed\n", __func__, __LINE__, fname);
+        return nullptr;
+    }
+    // 解码基本是顺序读
+    madvise(ptr, st.st_size, MADV_SEQUENTIAL);
+
+    cropvid_t *h = create(cropvid_t::FROM_MAPPED, fname, params);
+    h->data = (const uint8_t *)ptr;
+    h->size = st.st_size;
+    return h;
+}
+
+int cropvid_set_boxes(cropvid_t *h, const cropvid_box *boxes, int n) {
+    h->opts.boxes.clear();
+    for (int i = 0; i < n; i++) {
+        const cropvid_box &b = boxes[i];
+        if (b.x2 <= b.x1 || b.y2 <= b.y1) {
+            fprintf(stderr, "WARN: %s:%d invalid box: %d,%d,%d,%d\n", __func__, __LINE__, b.x1, b.y1, b.x2, b.y2);
+            continue;
+        }
+        h->opts.boxes.push_back({ b.x1, b.y1, b.x2, b.y2, cls_title(b.cls), b.score });
+    }
+    return h->opts.boxes.size();
+}
+
+int cropvid_set_packet_callback(cropvid_t *h, cropvid_packet_cb cb, void *opaque) {
+    h->on_packet = cb;
+    h->on_frame = nullptr;
+    h->cb_opaque = opaque;
+    return 0;
+}
+
+int cropvid_set_frame_callback(cropvid_t *h, cropvid_frame_cb cb, void *opaque) {
+    h->on_frame = cb;
+    h->on_packet = nullptr;
+    h->cb_opaque = opaque;
+    return 0;
+}
+
+static CropOutput *make_output(cropvid_t *h, const std::vector<Box> &boxes, int width, int height, double fps) {
+    h->out_boxes.clear();
+    for (auto &b: boxes) {
+        h->out_boxes.push_back({ b.x1, b.y1, b.x2, b.y2, title_cls(b.title), b.score });
+    }
+
+    if (h->on_packet) {
+        auto out = new PacketOutput;
+        int rc = out->open(boxes, width, height, fps, h->bitrate,
+                [h](int box, double stamp, AVPacket *pkt) {
+                    cropvid_packet p;
+                    p.box = box;
+                    p.data = pkt->data;
+                    p.size = pkt->size;
+                    p.pts = pkt->pts;
+                    p.dts = pkt->dts;
+                    p.key = (pkt->flags & AV_PKT_FLAG_KEY) != 0;
+                    p.stamp = stamp;
+                    return h->on_packet(h->cb_opaque, &p);
+                });
+        if (rc < 0) {
+            delete out;
+            return nullptr;
+        }
+        return out;
+    }
+
+    auto out = new FrameOutput;
+    out->open(boxes, [h](int box, double stamp, AVFrame *frame) {
+        cropvid_frame f;
+        f.box = box;
+        f.stamp = stamp;
+        f.width = frame->width;
+        f.height = frame->height;
+        for (int i = 0; i < 3; i++) {
+            f.data[i] = frame->data[i];
+            f.linesize[i] = frame->linesize[i];
+        }
+        return h->on_frame(h->cb_opaque, &f);
+    });
+    return out;
+}
+
+int cropvid_run(cropvid_t *h) {
+    if (!h->on_packet && !h->on_frame) {
+        fprintf(stderr, "ERR: %s:%d no packet or frame callback\n", __func__, __LINE__);
+        return -1;
+    }
+    if (h->opts.boxes.empty()) {
+        fprintf(stderr, "WARN: %s:%d no boxes\n", __func__, __LINE__);
+        return 1;
+    }
+
+    Opts opts = h->opts;
+    AVIOContext *io = nullptr;
+    if (h->source != cropvid_t::FROM_FILE) {
+        io = open_io(h);
+        if (!io) {
+            fprintf(stderr, "ERR: %s:%d cannot alloc avio\n", __func__, __LINE__);
+            return -1;
+        }
+        opts.dec.io = io;
+    }
+    opts.make_output = [h](const std::vector<Box> &boxes, int width, int height, double fps) {
+        return make_output(h, boxes, width, height, fps);
+    };
+
+    int rc = run_job(opts);
+    close_io(io);
+    return rc;
+}
+
+int cropvid_output_boxes(cropvid_t *h, const cropvid_box **boxes) {
+    *boxes = h->out_boxes.empty() ? nullptr : h->out_boxes.data();
+    return h->out_boxes.size();
+}
+
+void cropvid_close(cropvid_t *h) {
+    if (!h) return;
+    if (h->source == cropvid_t::FROM_MAPPED) {
+        munmap((void *)h->data, h->size);
+    }
+    delete h;
+}
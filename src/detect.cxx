@@ -0,0 +1,90 @@
+#include "detect.hxx"
+
+extern "C" {
+#   include <libswscale/swscale.h>
+}
+
+#include <stdio.h>
+
+Detector::~Detector() {
+    close();
+}
+
+int Detector::open(const DetConfig &cfg) {
+    __cfg = cfg;
+    try {
+        __net = cv::dnn::readNet(cfg.model, cfg.config ? cfg.config : "");
+    }
+    catch (const cv::Exception &e) {
+        fprintf(stderr, "ERR: %s:%d cannot load model %s: %s\n", __func__, __LINE__, cfg.model, e.what());
+        return -1;
+    }
+    if (__net.empty()) {
+        fprintf(stderr, "ERR: %s:%d cannot load model %s\n", __func__, __LINE__, cfg.model);
+        return -1;
+    }
+    __net.setPreferableBackend(cv::dnn::DNN_BACKEND_OPENCV);
+    __net.setPreferableTarget(cv::dnn::DNN_TARGET_CPU);
+    return 0;
+}
+
+void Detector::close() {
+    sws_freeContext(__sws);
+    __sws = nullptr;
+}
+
+int Detector::detect(const std::vector<AVFrame *> &frames, std::vector<Box> &boxes) {
+    // 缩放和颜色转换一次完成，直接写入 Mat
+    int size = __cfg.size;
+    std::vector<cv::Mat> images;
+    for (auto frame: frames) {
+        __sws = sws_getCachedContext(__sws, frame->width, frame->height, (AVPixelFormat)frame->format,
+                size, size, __cfg.rgb ? AV_PIX_FMT_RGB24 : AV_PIX_FMT_BGR24, SWS_BILINEAR, 0, 0, 0);
+        if (!__sws) {
+            fprintf(stderr, "ERR: %s:%d cannot create sws for %dx%d\n", __func__, __LINE__, frame->width, frame->height);
+            return -1;
+        }
+        cv::Mat img(size, size, CV_8UC3);
+        uint8_t *planes[4] = { img.data, 0, 0, 0 };
+        int strides[4] = { (int)img.step, 0, 0, 0 };
+        sws_scale(__sws, frame->data, frame->linesize, 0, frame->height, planes, strides);
+        images.push_back(img);
+    }
+    if (images.empty()) {
+        return 0;
+    }
+
+    cv::Mat out;
+    try {
+        cv::Mat blob = cv::dnn::blobFromImages(images, __cfg.scale, cv::Size(),
+                cv::Scalar(__cfg.mean, __cfg.mean, __cfg.mean), false, false);
+        __net.setInput(blob);
+        out = __net.forward();
+    }
+    catch (const cv::Exception &e) {
+        fprintf(stderr, "ERR: %s:%d detect failed: %s\n", __func__, __LINE__, e.what());
+        return -1;
+    }
+    if (out.dims != 4 || out.size[3] != 7) {
+        fprintf(stderr, "ERR: %s:%d unsupported output, need DetectionOutput [1, 1, N, 7]\n", __func__, __LINE__);
+        return -1;
+    }
+
+    const float *det = out.ptr<float>();
+    int n = out.size[2], found = 0;
+    for (int i = 0; i < n; i++, det += 7) {
+        int img = (int)det[0], cls = (int)det[1];
+        float conf = det[2];
+        if (img < 0 || img >= frames.size() || cls != __cfg.cls || conf < __cfg.conf) {
+            continue;
+        }
+        int w = frames[img]->width, h = frames[img]->height;
+        int x1 = det[3] * w, y1 = det[4] * h, x2 = det[5] * w, y2 = det[6] * h;
+        if (x2 <= x1 || y2 <= y1) {
+            continue;
+        }
+        boxes.push_back({ x1, y1, x2, y2, "person", conf });
+        found++;
+    }
+    return found;
+}
@@ -0,0 +1,42 @@
+#ifndef _detect_hh
+#define _detect_hh
+
+#include "media.hxx"
+
+#include <opencv2/dnn.hpp>
+
+struct SwsContext;
+
+/// 检测模型配置，默认为 MobileNet-SSD (caffe, VOC 类别)
+struct DetConfig {
+    const char *model = nullptr;    // 模型文件 (.caffemodel/.pb/.onnx ...)，为空不检测
+    const char *config = nullptr;   // 网络结构 (.prototxt/.pbtxt)，onnx 不需要
+    int size = 300;                 // 输入 size x size
+    float conf = 0.5f;              // 置信度阈值
+    int cls = 15;                   // 人的类别号，VOC 为 15，COCO 为 1
+    double scale = 1 / 127.5;       // 输入归一化: (v - mean) * scale
+    double mean = 127.5;
+    bool rgb = false;               // 输入通道顺序，默认 bgr
+    int frames = 1;                 // 检测帧数，第一帧开始每 interval 秒一帧，结果合并后 NMS
+    double interval = 1.0;
+};
+
+/// OpenCV DNN CPU 检测，输出为 DetectionOutput 格式 [1, 1, N, 7]:
+///     image_id, label, conf, x1, y1, x2, y2（坐标归一化到 0~1）
+/// 多帧合并为一个 batch 执行
+class Detector {
+    DetConfig __cfg;
+    cv::dnn::Net __net;
+    SwsContext *__sws = nullptr;
+
+public:
+    ~Detector();
+
+    int open(const DetConfig &cfg);
+    void close();
+
+    // frames 中检测到的人，坐标为原图像素，title 为 "person"，score 为置信度
+    int detect(const std::vector<AVFrame *> &frames, std::vector<Box> &boxes);
+};
+
+#endif // detect.hxx
@@ -0,0 +1,232 @@
+#include "index.hxx"
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <algorithm>
+
+static const char _magic[4] = { 'K', 'I', 'D', 'X' };
+// 2: 不再包含没有时间戳的关键帧，旧版本的索引重新生成
+static const int32_t _version = 2;
+
+std::string KeyIndex::path_of(const char *fname) {
+    return std::string(fname) + ".kidx";
+}
+
+int KeyIndex::__stat(const char *fname, int64_t *size, int64_t *mtime) {
+    struct stat st;
+    if (stat(fname, &st) < 0) {
+        return -1;
+    }
+    *size = st.st_size;
+    *mtime = st.st_mtime;
+    return 0;
+}
+
+int KeyIndex::load(const char *fname) {
+    __fname = fname;
+    __entries.clear();
+
+    int64_t fsize, mtime;
+    if (__stat(fname, &fsize, &mtime) < 0) {
+        return -1;
+    }
+
+    std::string path = path_of(fname);
+    FILE *fp = fopen(path.c_str(), "rb");
+    if (!fp) {
+        return -1;
+    }
+
+    char magic[4];
+    int32_t ver, extra_size;
+    int64_t cnt;
+    Stream &s = __stream;
+    bool ok = fread(magic, 4, 1, fp) == 1 && memcmp(magic, _magic, 4) == 0
+        && fread(&ver, sizeof(ver), 1, fp) == 1 && ver == _version
+        && fread(&__fsize, sizeof(__fsize), 1, fp) == 1
+        && fread(&__mtime, sizeof(__mtime), 1, fp) == 1
+        && fread(&s.sid, sizeof(s.sid), 1, fp) == 1
+        && fread(&s.codec_id, sizeof(s.codec_id), 1, fp) == 1
+        && fread(&s.width, sizeof(s.width), 1, fp) == 1
+        && fread(&s.height, sizeof(s.height), 1, fp) == 1
+        && fread(&s.format, sizeof(s.format), 1, fp) == 1
+        && fread(&s.time_base, sizeof(s.time_base), 1, fp) == 1
+        && fread(&s.duration, sizeof(s.duration), 1, fp) == 1
+        && fread(&extra_size, sizeof(extra_size), 1, fp) == 1 && extra_size >= 0;
+
+    // 长度字段按索引文件剩余的大小检查，损坏的文件不能导致分配失败
+    struct stat st;
+    long head = ftell(fp);
+    int64_t left = ok && head >= 0 && fstat(fileno(fp), &st) == 0 ? st.st_size - head : -1;
+    ok = ok && extra_size <= left - (int64_t)sizeof(cnt);
+    if (ok) {
+        s.extradata.resize(extra_size);
+        ok = extra_size == 0 || fread(s.extradata.data(), extra_size, 1, fp) == 1;
+    }
+    ok = ok && fread(&cnt, sizeof(cnt), 1, fp) == 1 && cnt > 0
+        && cnt <= (left - extra_size - (int64_t)sizeof(cnt)) / (int64_t)sizeof(Entry);
+    if (ok) {
+        __entries.resize(cnt);
+        ok = fread(__entries.data(), sizeof(Entry), cnt, fp) == cnt;
+    }
+    fclose(fp);
+
+    if (!ok) {
+        fprintf(stderr, "WARN: %s:%d invalid index file: %s\n", __func__, __LINE__, path.c_str());
+        __entries.clear();
+        s.extradata.clear();
+        return -1;
+    }
+
+    if (__fsize != fsize || __mtime != mtime) {
+        fprintf(stderr, "WARN: %s:%d index expired: %s\n", __func__, __LINE__, path.c_str());
+        __entries.clear();
+        return -1;
+    }
+
+    return 0;
+}
+
+int KeyIndex::build(const char *fname) {
+    __fname = fname;
+    __entries.clear();
+    if (__stat(fname, &__fsize, &__mtime) < 0) {
+        fprintf(stderr, "ERR: %s:%d cannot stat %s\n", __func__, __LINE__, fname);
+        return -1;
+    }
+
+    AVFormatContext *fc = nullptr;
+    int rc = avformat_open_input(&fc, fname, 0, 0);
+    if (rc < 0) {
+        fprintf(stderr, "ERR: %s:%d cannot open fname:%s\n", __func__, __LINE__, fname);
+        return -1;
+    }
+    avformat_find_stream_info(fc, 0);
+
+    Stream &s = __stream;
+    s.sid = -1;
+    for (int i = 0; i < fc->nb_streams; i++) {
+        AVCodecParameters *par = fc->streams[i]->codecpar;
+        if (par->codec_type == AVMEDIA_TYPE_VIDEO && avcodec_find_decoder(par->codec_id)) {
+            s.sid = i;
+            s.codec_id = par->codec_id;
+            s.width = par->width;
+            s.height = par->height;
+            s.format = par->format;
+            s.time_base = fc->streams[i]->time_base;
+            s.extradata.assign(par->extradata, par->extradata + par->extradata_size);
+            break;
+        }
+    }
+    if (s.sid < 0) {
+        fprintf(stderr, "ERR: %s:%d cannot find video stream from %s\n", __func__, __LINE__, fname);
+        avformat_close_input(&fc);
+        return -1;
+    }
+
+    AVPacket *pkt = av_packet_alloc();
+    int64_t last = AV_NOPTS_VALUE;
+    while (av_read_frame(fc, pkt) >= 0) {
+        if (pkt->stream_index == s.sid) {
+            int64_t pts = pkt->pts != AV_NOPTS_VALUE ? pkt->pts : pkt->dts;
+            // 没有时间戳的关键帧无法按时间查找，不加入索引
+            if ((pkt->flags & AV_PKT_FLAG_KEY) && pts != AV_NOPTS_VALUE) {
+                __entries.push_back({ pts, pkt->pos });
+            }
+            if (pts != AV_NOPTS_VALUE && (last == AV_NOPTS_VALUE || pts + pkt->duration > last)) {
+                last = pts + pkt->duration;
+            }
+        }
+        av_packet_unref(pkt);
+    }
+    av_packet_free(&pkt);
+    avformat_close_input(&fc);
+
+    // 个别格式关键帧 pts 不是单调的
+    std::sort(__entries.begin(), __entries.end(), [](const Entry &a, const Entry &b) {
+        return a.pts < b.pts;
+    });
+    s.duration = last == AV_NOPTS_VALUE || __entries.empty() ? 0 : last - __entries[0].pts;
+
+    if (__entries.empty()) {
+        fprintf(stderr, "ERR: %s:%d no keyframe in %s\n", __func__, __LINE__, fname);
+        return -1;
+    }
+    return 0;
+}
+
+int KeyIndex::save() {
+    std::string path = path_of(__fname.c_str());
+    FILE *fp = fopen(path.c_str(), "wb");
+    if (!fp) {
+        fprintf(stderr, "WARN: %s:%d cannot write index file: %s\n", __func__, __LINE__, path.c_str());
+        return -1;
+    }
+
+    const Stream &s = __stream;
+    int32_t extra_size = s.extradata.size();
+    int64_t cnt = __entries.size();
+    fwrite(_magic, 4, 1, fp);
+    fwrite(&_version, sizeof(_version), 1, fp);
+    fwrite(&__fsize, sizeof(__fsize), 1, fp);
+    fwrite(&__mtime, sizeof(__mtime), 1, fp);
+    fwrite(&s.sid, sizeof(s.sid), 1, fp);
+    fwrite(&s.codec_id, sizeof(s.codec_id), 1, fp);
+    fwrite(&s.width, sizeof(s.width), 1, fp);
+    fwrite(&s.height, sizeof(s.height), 1, fp);
+    fwrite(&s.format, sizeof(s.format), 1, fp);
+    fwrite(&s.time_base, sizeof(s.time_base), 1, fp);
+    fwrite(&s.duration, sizeof(s.duration), 1, fp);
+    fwrite(&extra_size, sizeof(extra_size), 1, fp);
+    fwrite(s.extradata.data(), 1, extra_size, fp);
+    fwrite(&cnt, sizeof(cnt), 1, fp);
+    size_t n = fwrite(__entries.data(), sizeof(Entry), cnt, fp);
+    fclose(fp);
+
+    if (n != cnt) {
+        fprintf(stderr, "WARN: %s:%d write index file failed: %s\n", __func__, __LINE__, path.c_str());
+        remove(path.c_str());
+        return -1;
+    }
+    return 0;
+}
+
+const KeyIndex::Entry *KeyIndex::find(int64_t pts) const {
+    auto it = std::upper_bound(__entries.begin(), __entries.end(), pts, [](int64_t v, const Entry &e) {
+        return v < e.pts;
+    });
+    if (it == __entries.begin()) {
+        return nullptr;
+    }
+    return &*(it - 1);
+}
+
+int KeyIndex::apply(AVFormatContext *fc) const {
+    const Stream &s = __stream;
+    if (s.sid < 0 || s.sid >= fc->nb_streams) {
+        return -1;
+    }
+
+    AVStream *stream = fc->streams[s.sid];
+    AVCodecParameters *par = stream->codecpar;
+    if (par->codec_type != AVMEDIA_TYPE_VIDEO || par->codec_id != s.codec_id) {
+        return -1;
+    }
+    if (par->width <= 0 || par->height <= 0) {
+        par->width = s.width;
+        par->height = s.height;
+    }
+    if (par->format < 0) {
+        par->format = s.format;
+    }
+    if (!par->extradata_size && !s.extradata.empty()) {
+        par->extradata = (uint8_t *)av_mallocz(s.extradata.size() + AV_INPUT_BUFFER_PADDING_SIZE);
+        memcpy(par->extradata, s.extradata.data(), s.extradata.size());
+        par->extradata_size = s.extradata.size();
+    }
+    if (stream->duration <= 0 || stream->duration == AV_NOPTS_VALUE) {
+        stream->duration = s.duration;
+    }
+    return 0;
+}
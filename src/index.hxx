@@ -0,0 +1,61 @@
+#ifndef _key_index_hh
+#define _key_index_hh
+
+extern "C" {
+#   include <libavformat/avformat.h>
+}
+
+#include <stdint.h>
+#include <vector>
+#include <string>
+
+/// 输入文件的关键帧索引，保存为 <fname>.kidx
+/// 记录视频流参数和每个关键帧的 pts/字节偏移，文件大小或修改时间变化后失效
+class KeyIndex {
+public:
+    struct Entry {
+        int64_t pts;
+        int64_t pos;
+    };
+
+    // 缓存的视频流参数，用于跳过 avformat_find_stream_info
+    struct Stream {
+        int sid = -1;
+        int codec_id = 0;
+        int width = 0, height = 0, format = -1;
+        AVRational time_base = { 0, 1 };
+        int64_t duration = 0;       // time_base 为单位
+        std::vector<uint8_t> extradata;
+    };
+
+private:
+    std::string __fname;
+    int64_t __fsize = 0, __mtime = 0;
+
+    Stream __stream;
+    std::vector<Entry> __entries;
+
+public:
+    static std::string path_of(const char *fname);
+
+    // 0 成功，< 0 不存在、格式错误或已过期
+    int load(const char *fname);
+    // 只解复用不解码，扫描整个文件
+    int build(const char *fname);
+    int save();
+
+    bool empty() const { return __entries.empty(); }
+    const Stream &stream() const { return __stream; }
+    const std::vector<Entry> &entries() const { return __entries; }
+
+    // pts <= 给定值的最后一个关键帧，没有返回 nullptr
+    const Entry *find(int64_t pts) const;
+
+    // 用缓存参数补全 fc 中对应视频流
+    int apply(AVFormatContext *fc) const;
+
+private:
+    static int __stat(const char *fname, int64_t *size, int64_t *mtime);
+};
+
+#endif // index.hxx
@@ -0,0 +1,809 @@
+#include "job.hxx"
+#include "pipeline.hxx"
+#include "output.hxx"
+#include "mosaic.hxx"
+#include "shm.hxx"
+#include "stats.hxx"
+#include "boxes.hxx"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+
+void init_opts(Opts *opts) {
+    opts->box_fname = "act_box.txt";
+    opts->track_fname = 0;
+    opts->track_save = 0;
+    opts->from = 60.0;
+    opts->duration = 60.0;
+    opts->target_width = 320;
+    opts->target_height = 240;
+    opts->fps = 0;
+    opts->max_person_cnt = 0;
+    opts->chunks = 1;
+    opts->stamp_origin = -1.0;
+    opts->nms_iou = 0.7f;
+    opts->share_iou = 0.9f;
+    opts->debug = 0;
+    opts->verbose = 1;
+    opts->progress = 1.0;
+    opts->report = 0;
+    opts->out_prefix = "crop";
+    opts->mux = 0;
+    opts->mosaic = 0;
+    opts->fragmented = 0;
+    opts->segment = 0;
+    opts->tensor = 0;
+    opts->shm_name = 0;
+    opts->shm_slots = 64;
+    opts->shm_block = 0;
+    opts->batch_fname = 0;
+    opts->budget = 0;
+    opts->batch_jobs = 0;
+    opts->serve_path = 0;
+    opts->serve_queue = 64;
+    opts->win_gap = 5.0;
+    opts->threads = 0;
+    opts->mem_budget = 0;
+    opts->crop_backend = FrameCrop::FILTER;
+    opts->ext_left = 0.3;
+    opts->ext_right = 0.3;
+    opts->ext_top = 0.2;
+#ifdef WITH_TEA
+    opts->tea_model_path = 0;
+    opts->tea_enable = false;
+#endif // tea
+}
+
+Box extend_box(const Opts &opts, const Box &box) {
+    int w = box.x2 - box.x1, h = box.y2 - box.y1;
+    Box b = box;
+    b.x1 -= w * opts.ext_left;
+    b.x2 += w * opts.ext_right;
+    b.y1 -= h * opts.ext_top;
+    return b;
+}
+
+/// 检测期间缓存的解码帧上限，超过后改为检测完 seek 回起点重新解码
+static const int64_t DET_CACHE_BYTES = 128LL << 20;
+
+static int64_t frame_bytes(const AVFrame *frame) {
+    int64_t n = 0;
+    for (int i = 0; i < AV_NUM_DATA_POINTERS && frame->buf[i]; i++) {
+        n += frame->buf[i]->size;
+    }
+    return n;
+}
+
+int detect_boxes(const Opts &opts, VideoDec *input, std::vector<Box> &boxes) {
+    Detector det;
+    if (det.open(opts.det) < 0) {
+        return -1;
+    }
+
+    // 采样帧之间的帧也缓存，crop 时使用，不需要再次解码；
+    // 超过 DET_CACHE_BYTES 时只保留采样帧，检测完 seek 回起点（不能 seek 的输入提前结束采样）
+    std::vector<std::pair<double, AVFrame *>> frames;
+    std::vector<AVFrame *> samples;
+    int64_t cached = 0;
+    bool reseek = false;
+    double end = opts.from + opts.duration, next = -1.0;
+    while (samples.size() < opts.det.frames) {
+        double stamp;
+        AVFrame *frame;
+        if (input->get_frame(&stamp, &frame) <= 0) {
+            break;
+        }
+        if (stamp + 0.001 >= end) {
+            if (!reseek) frames.push_back({ stamp, av_frame_clone(frame) });
+            av_frame_unref(frame);
+            break;
+        }
+        bool sample = next < 0 || stamp + 0.001 >= next;
+        if (!sample && reseek) {
+            av_frame_unref(frame);
+            continue;
+        }
+
+        AVFrame *f = av_frame_clone(frame);
+        av_frame_unref(frame);
+        if (sample) {
+            samples.push_back(f);
+            next = stamp + opts.det.interval;
+        }
+        if (reseek) {
+            continue;
+        }
+        frames.push_back({ stamp, f });
+        cached += frame_bytes(f);
+        if (cached > DET_CACHE_BYTES) {
+            if (!input->seekable()) {
+                fprintf(stderr, "WARN: %s:%d detect cache exceeds %lld MB on unseekable input, %d samples only\n",
+                        __func__, __LINE__, (long long)(DET_CACHE_BYTES >> 20), (int)samples.size());
+                break;
+            }
+            // 只保留采样帧
+            for (auto &p: frames) {
+                if (std::find(samples.begin(), samples.end(), p.second) == samples.end()) {
+                    av_frame_free(&p.second);
+                }
+            }
+            frames.clear();
+            reseek = true;
+        }
+    }
+
+    int64_t t = now_ns();
+    int rc = det.detect(samples, boxes);
+    if (opts.verbose) {
+        fprintf(stdout, "DEBUG: detect %d frames, %d persons, %.1f ms%s\n", (int)samples.size(), rc,
+                (now_ns() - t) / 1e6, reseek ? ", seek back" : "");
+    }
+
+    if (reseek) {
+        for (auto f: samples) {
+            av_frame_free(&f);
+        }
+        input->seek(opts.from);
+    }
+    else {
+        for (auto &f: frames) {
+            input->unget(f.first, f.second);
+        }
+    }
+    return rc < 0 ? -1 : 0;
+}
+
+std::vector<Box> load_boxes_from_file(const Opts &opts) {
+    const char *fname = opts.box_fname;
+    // 文件每行一个 box，分别为 x1 y1 x2 y2\n
+    // 
+    FILE *fp = fopen(fname, "r");
+    if (!fp) {
+        fprintf(stderr, "ERR: %s:%d cannot open boxes file;%s\n", __func__, __LINE__, fname);
+        return {};
+    }
+
+    std::vector<Box> boxes;
+    while (!feof(fp)) {
+        int x1, y1, x2, y2, cls;
+        double score;
+        int rc = fscanf(fp, "%d %d %d %d %lf %d\n", &x1, &y1, &x2, &y2, &score, &cls);
+        if (rc == 6) {
+            int w = x2 - x1, h = y2 - y1;
+            if (w <= 0 || h <= 0) {
+                fprintf(stderr, "WARN: %s:%d invalid box: %d,%d,%d,%d\n", __func__, __LINE__,
+                    x1, y1, x2, y2);
+            }
+            else {
+                // 扩展后可能越界，得到图像大小后由 clamp_boxes 裁剪
+                boxes.push_back(extend_box(opts, {x1, y1, x2, y2, cls_title(cls), score}));
+            }
+        }
+    }
+
+    fclose(fp);
+
+    return boxes;
+}
+
+/// 运行报告 json
+static void write_report(FILE *fp, const Opts &opts, const std::vector<Box> &boxes, const RunStats &stats,
+        const CropOutput *out, const FrameCrop &cropper) {
+    fprintf(fp, "{\"input\":\"%s\",\"from\":%.3f,\"duration\":%.3f,\"out_fps\":%.3f,\"threads\":%d,\"crop\":\"%s\",\n",
+            json_escape(opts.inp_fname).c_str(), opts.from, opts.duration, opts.fps, opts.threads,
+            opts.crop_backend == FrameCrop::NATIVE ? "native" : "filter");
+    fprintf(fp, "\"pool\":{\"total\":%d,\"high_water\":%d},\n", cropper.pool_total(), cropper.pool_high_water());
+    stats.write_json(fp, boxes, out);
+    fprintf(fp, "}\n");
+}
+
+/// 运行报告 <out_prefix>-report.json，有 on_report 时同时交给调用者
+static int save_report(const Opts &opts, const std::vector<Box> &boxes, const RunStats &stats,
+        const CropOutput *out, const FrameCrop &cropper) {
+    if (opts.on_report) {
+        char *buf = nullptr;
+        size_t len = 0;
+        FILE *mem = open_memstream(&buf, &len);
+        if (mem) {
+            write_report(mem, opts, boxes, stats, out, cropper);
+            fclose(mem);
+            opts.on_report(std::string(buf, len));
+            free(buf);
+        }
+    }
+    if (!opts.report) {
+        return 0;
+    }
+
+    std::string fname = opts.out_prefix + "-report.json";
+    FILE *fp = fopen(fname.c_str(), "w");
+    if (!fp) {
+        fprintf(stderr, "ERR: %s:%d cannot open report: %s\n", __func__, __LINE__, fname.c_str());
+        return -1;
+    }
+    write_report(fp, opts, boxes, stats, out, cropper);
+    fclose(fp);
+    return 0;
+}
+
+/// 内存预算下每个框的开销（经验估计）: 编码器（单线程 zerolatency，约 4 帧缓存）+ 队列中的 crop 帧
+/// 解码器的参考帧、线程缓存和解码队列为固定开销；返回允许的框数，queue_size 可能被缩短
+static int plan_budget(const Opts &opts, int src_w, int src_h, int boxes, int *queue_size) {
+    const double MB = 1024.0 * 1024.0;
+    int dec_threads = opts.dec.threads > 0 ? opts.dec.threads : 4;
+    double fixed = src_w * src_h * 1.5 * (16 + dec_threads + *queue_size);
+
+    double frame = 0, enc = 0;
+    for (int k = 0; k <= opts.levels.size(); k++) {
+        int w = k ? opts.levels[k-1].first : opts.target_width;
+        int h = k ? opts.levels[k-1].second : opts.target_height;
+        frame += w * h * 1.5;
+        enc += w * h * 1.5 * 4 + 512 * 1024;
+    }
+
+    double budget = opts.mem_budget * MB - fixed;
+    int q = *queue_size;
+    while (q > 2 && boxes * (enc + frame * q) > budget) {
+        q /= 2;
+    }
+    *queue_size = q;
+    int max_boxes = budget > 0 ? (int)(budget / (enc + frame * q)) : 0;
+    if (opts.verbose) {
+        fprintf(stdout, "DEBUG: memory budget %d MB: fixed %.1f MB, %.2f MB per box, queue %d, max %d boxes\n",
+                opts.mem_budget, fixed / MB, (enc + frame * q) / MB, q, max_boxes);
+    }
+    return max_boxes;
+}
+
+/// 创建一级输出，失败返回 nullptr
+static CropOutput *open_output(const Opts &opts, const std::vector<Box> &boxes, const std::string &prefix,
+        int width, int height, double fps) {
+    if (opts.make_output) {
+        return opts.make_output(boxes, width, height, fps);
+    }
+
+    // 压缩为文件存储，follow 模式输出 fragmented mp4，处理过程中即可读取
+    bool live = opts.dec.follow > 0 || opts.fragmented;
+    CropOutput *out = nullptr;
+    int rc;
+    if (opts.shm_name) {
+        // 共享内存名字同样按级区分
+        std::string name = opts.shm_name + prefix.substr(opts.out_prefix.size());
+        auto shm = new ShmOutput;
+        rc = shm->open(boxes, name.c_str(), width, height, opts.shm_slots, opts.shm_block);
+        out = shm;
+    }
+    else if (opts.tensor) {
+        auto tensor = new TensorOutput;
+        rc = tensor->open(boxes, prefix.c_str(), width, height, fps, opts.tensor_cfg);
+        out = tensor;
+    }
+    else if (opts.mux) {
+        // 所有流必须在写头之前建好，编码器不能延迟打开
+        EncConfig enc;
+        if (opts.mem_budget > 0) {
+            enc.threads = 1;
+            enc.low_latency = true;
+        }
+        std::string fname = prefix + "-crops." + opts.mux;
+        auto mux = new MuxOutput;
+        rc = mux->open(boxes, fname.c_str(), width, height, fps, live, enc);
+        out = mux;
+    }
+    else if (opts.mosaic) {
+        std::string fname = prefix + "-mosaic.mp4";
+        auto mosaic = new MosaicOutput;
+        rc = mosaic->open(boxes, fname.c_str(), width, height, fps, 0, live);
+        out = mosaic;
+    }
+    else {
+        // 内存预算下编码器单线程、没有 lookahead，由流水线的编码线程调度；第一帧时才打开
+        EncConfig enc;
+        enc.segment = opts.segment;
+        bool budget = opts.mem_budget > 0;
+        if (budget) {
+            enc.threads = 1;
+            enc.low_latency = true;
+        }
+        auto files = new FileOutput;
+        rc = files->open(boxes, prefix.c_str(), width, height, fps, live, enc, budget);
+        out = files;
+    }
+    if (rc < 0) {
+        out->close();
+        delete out;
+        return nullptr;
+    }
+
+    // 张量、共享内存和拼图需要每帧都有，只有单独的视频文件可以跳过静止帧
+    if (opts.gate.threshold > 0 && !opts.shm_name && !opts.tensor && !opts.mosaic) {
+        out = new GateOutput(out, boxes.size(), opts.gate);
+    }
+    return out;
+}
+
+/// 一帧: crop -> 输出，统计每个框的结果
+static void crop_frame(FrameCrop *cropper, CropOutput *out, RunStats *stats, AVFrame *frame, double stamp) {
+    int64_t t = now_ns();
+    if (cropper->put(frame, stamp) < 0) {
+        for (int j = 0; j < cropper->size(); j++) {
+            stats->box(j).failed++;
+        }
+        return;
+    }
+
+    const std::vector<AVFrame *> &cropped_frames = cropper->get();
+    stats->crop.add(now_ns() - t);
+    for (int j = 0; j < cropped_frames.size(); j++) {
+        BoxStat &bs = stats->box(j);
+        if (cropped_frames[j]) {
+            AVFrame *cf = cropped_frames[j];
+            t = now_ns();
+            int rc = out->put_frame(j, stamp, cf);
+            t = now_ns() - t;
+            stats->encode.add(t);
+            bs.encode.add(t);
+            if (rc < 0) bs.failed++;
+            else if (rc > 0) bs.gated++;
+            else bs.frames++;
+            cropper->release(cf);
+        }
+        else {
+            bs.failed++;
+        }
+    }
+}
+
+/// 单线程: 解码 -> crop -> 编码
+static int crop_loop(const Opts &opts, VideoDec *input, FrameCrop *cropper, CropOutput *out,
+        RunStats *stats, AVFrame *frame, double stamp) {
+    int rc, frame_cnt = 0;
+    // 结束时间不包含在内，分段处理时相邻两段不重复
+    while (stamp + 0.001 < opts.from + opts.duration) {
+        frame_cnt ++;
+        stats->frame(stamp);
+        crop_frame(cropper, out, stats, frame, stamp);
+        av_frame_unref(frame);
+
+        // 下一帧 ..
+        int64_t t = now_ns();
+        rc = input->get_frame(&stamp, &frame);
+        stats->decode.add(now_ns() - t);
+        if (rc == 0) {
+            if (opts.verbose) fprintf(stdout, "DEBUG: EOF, done!!\n");
+            break;
+        }
+        else if (rc < 0) {
+            fprintf(stderr, "ERR: rc=%d\n", rc);
+            break;
+        }
+    }
+
+    return frame_cnt;
+}
+
+/// 一个时间窗口的 crop: 框、cropper、各级输出和统计，单窗口和多窗口共用
+struct CropTask {
+    Opts opts;                  // 该窗口的参数: from/duration/框/输出前缀
+    TrackSet tracks;
+    std::vector<Box> boxes;
+    bool use_tracks = false;
+    int queue_size = 16;        // 流水线队列长度，内存预算下可能缩短
+    FrameCrop cropper;
+    CropOutput *out = nullptr;
+    RunStats *stats = nullptr;
+    int frames = 0;
+    int64_t dropped = 0;        // 打开时解码器已丢弃的帧数
+
+    ~CropTask() { delete stats; }
+};
+
+/// 以第一帧 frame（时间戳 stamp）确定框，打开 cropper 和各级输出
+/// detected: 检测到的框（use_det 时使用）；返回 0 成功，1 没有框，< 0 失败，失败时已关闭
+static int open_task(CropTask *task, const std::vector<Box> &detected, bool use_det, AVFrame *frame,
+        double stamp, double out_fps, AVRational time_base) {
+    const Opts &opts = task->opts;
+    std::vector<Box> &boxes = task->boxes;
+    task->use_tracks = opts.track_fname && opts.boxes.empty();
+    if (task->use_tracks) {
+        // 随时间变化的框，初始位置取第一帧时刻
+        if (task->tracks.load(opts.track_fname) < 0) {
+            return -1;
+        }
+        if (opts.track_save) {
+            task->tracks.save(opts.track_save);
+        }
+        task->tracks.set_ext(opts.ext_left, opts.ext_right, opts.ext_top);
+        task->tracks.at(stamp, boxes);
+    }
+    else {
+        if (!opts.boxes.empty() || use_det) {
+            for (auto &b: use_det ? detected : opts.boxes) {
+                boxes.push_back(extend_box(opts, b));
+            }
+        }
+        else {
+            boxes = opts.box_fname ? load_boxes_from_file(opts) :
+                std::vector<Box>({ {300, 400, 700, 700, "none", 0.0} });
+        }
+
+        // 裁剪到图像内，去掉重复检测，最多 max_person_cnt 个
+        size_t cnt = boxes.size();
+        boxes = clamp_boxes(boxes, frame->width, frame->height);
+        // 几乎相同的框保留到后面共用 crop，否则默认参数下 nms 会先去掉它们
+        boxes = nms_boxes(boxes, opts.nms_iou, opts.max_person_cnt, opts.share_iou);
+        if (boxes.size() != cnt && opts.verbose) {
+            fprintf(stdout, "DEBUG: %d boxes, %d after clamp/nms/top-k\n", (int)cnt, (int)boxes.size());
+        }
+    }
+
+    if (boxes.empty()) {
+        fprintf(stderr, "WARN: %s:%d no boxes from %s\n", __func__, __LINE__, opts.box_fname ? opts.box_fname : "-");
+        return 1;
+    }
+
+    // 内存预算: 超出时按 score 减少框数，并缩短流水线队列
+    if (opts.mem_budget > 0) {
+        int max_boxes = plan_budget(opts, frame->width, frame->height, boxes.size(), &task->queue_size);
+        if (max_boxes < 1) {
+            fprintf(stderr, "ERR: %s:%d memory budget %d MB is too small\n", __func__, __LINE__, opts.mem_budget);
+            return -1;
+        }
+        if (boxes.size() > max_boxes) {
+            if (task->use_tracks) {
+                // 轨迹和框一一对应，不能减少
+                fprintf(stderr, "WARN: %s:%d %d tracks exceed memory budget (%d boxes)\n", __func__, __LINE__,
+                        (int)boxes.size(), max_boxes);
+            }
+            else {
+                fprintf(stderr, "WARN: %s:%d memory budget allows %d of %d boxes, keep top score\n", __func__, __LINE__,
+                        max_boxes, (int)boxes.size());
+                boxes = nms_boxes(boxes, 0, max_boxes);
+            }
+        }
+    }
+
+    // 几乎相同的框只 crop 一次，结果分发给各自的输出；轨迹的框各自移动，不能共用
+    std::vector<Box> regions = boxes;
+    std::vector<int> region_of;
+    if (!task->use_tracks) {
+        region_of = share_regions(boxes, opts.share_iou, regions);
+        if (regions.size() != boxes.size() && opts.verbose) {
+            fprintf(stdout, "DEBUG: %d boxes share %d crop regions\n", (int)boxes.size(), (int)regions.size());
+        }
+    }
+
+    // 扣图
+    FrameCrop &cropper = task->cropper;
+    int rc = cropper.open(frame->width, frame->height, (AVPixelFormat)frame->format,
+            regions, opts.target_width, opts.target_height, opts.crop_backend, time_base);
+    if (rc >= 0 && !region_of.empty()) {
+        rc = cropper.set_fanout(region_of);
+    }
+    // 小的输出大小从 crop 结果再缩放，不重复解码和 crop
+    for (int k = 0; k < opts.levels.size() && rc >= 0; k++) {
+        rc = cropper.add_level(opts.levels[k].first, opts.levels[k].second);
+    }
+    if (rc < 0) {
+        fprintf(stderr, "ERR: %s:%d cannot open cropper!\n", __func__, __LINE__);
+        cropper.close();
+        return -1;
+    }
+    if (task->use_tracks) {
+        cropper.set_tracks(&task->tracks);
+    }
+
+    // 每级输出大小一个输出，只有一级时直接使用
+    CropOutput *out = nullptr;
+    for (int k = 0; k < cropper.levels() && rc >= 0; k++) {
+        int w = k ? opts.levels[k-1].first : opts.target_width;
+        int h = k ? opts.levels[k-1].second : opts.target_height;
+        std::string prefix = opts.out_prefix;
+        if (k) {
+            prefix += "-" + std::to_string(w) + "x" + std::to_string(h);
+        }
+        CropOutput *o = open_output(opts, boxes, prefix, w, h, out_fps);
+        if (!o) {
+            rc = -1;
+        }
+        else if (cropper.levels() == 1) {
+            out = o;
+        }
+        else {
+            if (!out) out = new LevelOutput(boxes.size());
+            ((LevelOutput *)out)->add(o);
+        }
+    }
+    if (rc < 0) {
+        fprintf(stderr, "ERR: %s:%d cannot open outputs!\n", __func__, __LINE__);
+        if (out) {
+            out->close();
+            delete out;
+        }
+        cropper.close();
+        return -1;
+    }
+
+    if (opts.stamp_origin >= 0) {
+        out->set_origin(opts.stamp_origin);
+    }
+    task->out = out;
+    task->stats = new RunStats(cropper.size(), opts.progress > 0, opts.progress);
+    if (opts.on_progress) {
+        task->stats->set_progress(opts.on_progress);
+    }
+    return 0;
+}
+
+/// 关闭输出（编码器 flush），写运行报告
+static void close_task(CropTask *task, int64_t skipped, std::vector<std::string> *files) {
+    const Opts &opts = task->opts;
+    FrameCrop &cropper = task->cropper;
+    RunStats &stats = *task->stats;
+    stats.skipped = skipped;
+    if (opts.debug) {
+        fprintf(stdout, "DEBUG: crop frame pool: %d frames, high water %d\n",
+                cropper.pool_total(), cropper.pool_high_water());
+        for (int j = 0; j < cropper.size() && opts.gate.threshold > 0; j++) {
+            BoxStat &bs = stats.box(j);
+            fprintf(stdout, "DEBUG: box #%d: %lld frames, %lld static skipped\n", j,
+                    (long long)bs.frames.load(), (long long)bs.gated.load());
+        }
+    }
+
+    // 编码器 flush 之后字节数才完整
+    task->out->close();
+    if (files) {
+        auto f = task->out->files();
+        files->insert(files->end(), f.begin(), f.end());
+    }
+    stats.finish();
+    if (opts.report || opts.on_report) {
+        // 统计按级排列，每级重复一次框
+        std::vector<Box> all;
+        for (int k = 0; k < cropper.levels(); k++) {
+            all.insert(all.end(), task->boxes.begin(), task->boxes.end());
+        }
+        save_report(opts, all, stats, task->out, cropper);
+    }
+    delete task->out;
+    task->out = nullptr;
+    cropper.close();
+}
+
+static int run_windows(const Opts &opts, std::vector<std::string> *files);
+
+int run_job(const Opts &opts, std::vector<std::string> *files) {
+    if (files) {
+        files->clear();
+    }
+    if (!opts.windows.empty()) {
+        return run_windows(opts, files);
+    }
+    if (!opts.box_fname && opts.boxes.empty()) {
+        fprintf(stderr, "WARN: %s:%d no boxes fname, using default: {300, 400, 700, 700}\n", __func__, __LINE__);
+    }
+
+    VideoDec input;
+    int rc = input.open(opts.inp_fname.c_str(), opts.dec);
+    if (rc < 0) {
+        fprintf(stderr, "ERR: %s:%d cannot open input fname:%s\n", __func__, __LINE__, opts.inp_fname.c_str());
+        return -1;
+    }
+
+    double duration = input.get_duration();
+    if (opts.verbose) {
+        fprintf(stdout, "DEBUG: duration: %.03f seconds\n", duration);
+    }
+
+    input.seek(opts.from);
+    input.set_rate(opts.fps);
+
+    // 没有指定时使用输入帧率
+    double out_fps = opts.fps > 0 ? opts.fps : input.frame_rate();
+    if (out_fps <= 0) out_fps = 25;
+
+    double stamp;
+    AVFrame *frame;
+
+    // 检测人得到框，期间解码的帧放回 input，crop 仍从第一帧开始
+    std::vector<Box> detected;
+    bool use_det = opts.det.model && opts.boxes.empty() && !opts.track_fname;
+    if (use_det && detect_boxes(opts, &input, detected) < 0) {
+        input.close();
+        return -1;
+    }
+
+    // 第一帧
+    rc = input.get_frame(&stamp, &frame);
+    if (rc <= 0) {
+        fprintf(stderr, "ERR: %s:%d no any valid picture!!!\n", __func__, __LINE__);
+        input.close();
+        return -1;
+    }
+
+    CropTask task;
+    task.opts = opts;
+    rc = open_task(&task, detected, use_det, frame, stamp, out_fps, input.time_base());
+    if (rc != 0) {
+        input.close();
+        return rc;
+    }
+
+    int frame_cnt = 0;
+    if (opts.verbose) {
+        fprintf(stdout, "begin crop from %.03f vs %.03f==>\n", opts.from, stamp);
+    }
+    if (opts.threads > 0) {
+        Pipeline pipeline(opts.threads, task.queue_size);
+        frame_cnt = pipeline.run(&input, &task.cropper, task.out, task.stats, frame, stamp, opts.from + opts.duration);
+    }
+    else {
+        frame_cnt = crop_loop(opts, &input, &task.cropper, task.out, task.stats, frame, stamp);
+    }
+    if (opts.verbose) {
+        fprintf(stderr, "\n All done: %s, %d frames, %lld skipped\n", opts.inp_fname.c_str(), frame_cnt,
+                (long long)input.dropped());
+    }
+
+    close_task(&task, input.dropped(), files);
+    input.close();
+
+    return 0;
+}
+
+/// 第 k 个窗口的参数: 自己的时间段、框文件和输出前缀
+static Opts window_opts(const Opts &opts, const Opts::Window &win) {
+    Opts w = opts;
+    w.windows.clear();
+    w.from = win.from;
+    w.duration = win.duration;
+    if (win.box_fname) {
+        // 窗口自己的框优先于轨迹、检测和调用者的框
+        w.box_fname = win.box_fname;
+        w.track_fname = 0;
+        w.boxes.clear();
+    }
+    char suffix[32];
+    snprintf(suffix, sizeof(suffix), "-win%02d", win.index);
+    w.out_prefix = opts.out_prefix + suffix;
+    return w;
+}
+
+/// 多个时间窗口一次解码: 窗口按起点排序，可以重叠，每帧交给包含它的所有窗口
+/// 窗口开始时打开输出，结束时关闭；没有窗口时跳到下一个窗口的起点:
+/// 距离超过 win_gap 秒时 seek 到关键帧，否则继续解码，丢弃期间的帧（跳过非参考帧）
+/// crop 和编码在解码线程中执行，不使用流水线
+static int run_windows(const Opts &opts, std::vector<std::string> *files) {
+    std::vector<Opts::Window> wins = opts.windows;
+    std::stable_sort(wins.begin(), wins.end(), [](const Opts::Window &a, const Opts::Window &b) {
+        return a.from < b.from;
+    });
+
+    VideoDec input;
+    int rc = input.open(opts.inp_fname.c_str(), opts.dec);
+    if (rc < 0) {
+        fprintf(stderr, "ERR: %s:%d cannot open input fname:%s\n", __func__, __LINE__, opts.inp_fname.c_str());
+        return -1;
+    }
+    input.seek(wins[0].from);
+    input.set_rate(opts.fps);
+
+    double out_fps = opts.fps > 0 ? opts.fps : input.frame_rate();
+    if (out_fps <= 0) out_fps = 25;
+
+    // 检测只在第一个窗口的起点执行一次，没有自己框文件的窗口共用
+    std::vector<Box> detected;
+    bool use_det = opts.det.model && opts.boxes.empty() && !opts.track_fname;
+    if (use_det) {
+        Opts first = window_opts(opts, wins[0]);
+        if (detect_boxes(first, &input, detected) < 0) {
+            input.close();
+            return -1;
+        }
+    }
+
+    std::vector<CropTask *> active;
+    int next = 0, failed = 0, frame_cnt = 0, seeks = 0;
+    double stamp;
+    AVFrame *frame;
+    int64_t t = now_ns();
+    rc = input.get_frame(&stamp, &frame);
+    int64_t dec_ns = now_ns() - t;
+    while (rc > 0) {
+        // 结束时间不包含在内
+        for (int i = 0; i < active.size(); ) {
+            CropTask *task = active[i];
+            if (stamp + 0.001 < task->opts.from + task->opts.duration) {
+                i++;
+                continue;
+            }
+            if (opts.verbose) {
+                fprintf(stderr, "\n window done: %s, %d frames\n", task->opts.out_prefix.c_str(), task->frames);
+            }
+            close_task(task, input.dropped() - task->dropped, files);
+            delete task;
+            active.erase(active.begin() + i);
+        }
+
+        // 起点不晚于当前帧的窗口
+        while (next < wins.size() && wins[next].from <= stamp + 0.001) {
+            const Opts::Window &win = wins[next];
+            if (stamp + 0.001 >= win.from + win.duration) {
+                fprintf(stderr, "ERR: %s:%d window #%d [%.03f, %.03f) has no frames\n", __func__, __LINE__,
+                        win.index, win.from, win.from + win.duration);
+                failed++;
+                next++;
+                continue;
+            }
+            CropTask *task = new CropTask;
+            task->opts = window_opts(opts, win);
+            task->dropped = input.dropped();
+            int r = open_task(task, detected, use_det && !win.box_fname, frame, stamp, out_fps, input.time_base());
+            if (r == 0) {
+                if (opts.verbose) {
+                    fprintf(stdout, "begin window #%d from %.03f vs %.03f==>\n", win.index, win.from, stamp);
+                }
+                active.push_back(task);
+            }
+            else {
+                if (r < 0) failed++;
+                delete task;
+            }
+            next++;
+        }
+
+        if (active.empty()) {
+            av_frame_unref(frame);
+            if (next >= wins.size()) {
+                break;
+            }
+            double to = wins[next].from;
+            // 不能 seek 的输入（管道、自定义 IO）只能继续解码
+            if (to - stamp > opts.win_gap && input.seekable()) {
+                input.seek(to);
+                seeks++;
+            }
+            else {
+                input.skip_to(to);
+            }
+        }
+        else {
+            frame_cnt++;
+            for (auto task: active) {
+                task->frames++;
+                task->stats->decode.add(dec_ns);
+                task->stats->frame(stamp);
+                crop_frame(&task->cropper, task->out, task->stats, frame, stamp);
+            }
+            av_frame_unref(frame);
+        }
+
+        t = now_ns();
+        rc = input.get_frame(&stamp, &frame);
+        dec_ns = now_ns() - t;
+    }
+    if (rc < 0) {
+        fprintf(stderr, "ERR: %s:%d decode failed, rc=%d\n", __func__, __LINE__, rc);
+        failed++;
+    }
+
+    // 文件结束时还没有结束的窗口
+    for (auto task: active) {
+        close_task(task, input.dropped() - task->dropped, files);
+        delete task;
+    }
+    for (; next < wins.size(); next++) {
+        fprintf(stderr, "ERR: %s:%d window #%d from %.03f is beyond the end of input\n", __func__, __LINE__,
+                wins[next].index, wins[next].from);
+        failed++;
+    }
+    if (opts.verbose) {
+        fprintf(stderr, "\n All done: %s, %d windows, %d frames, %d seeks, %lld skipped\n", opts.inp_fname.c_str(),
+                (int)wins.size(), frame_cnt, seeks, (long long)input.dropped());
+    }
+    input.close();
+
+    return failed ? -1 : 0;
+}
@@ -0,0 +1,97 @@
+#ifndef _job_hh
+#define _job_hh
+
+#include "media.hxx"
+#include "tensor.hxx"
+#include "detect.hxx"
+#include "motion.hxx"
+
+#include <string>
+#include <vector>
+#include <functional>
+
+class CropOutput;
+
+struct Opts {
+    std::string inp_fname;  // 输入视频文件名字
+    const char *box_fname;  // 框描述文件
+    const char *track_fname;    // 框轨迹文件 (.trk 或文本)，设置后忽略 box_fname
+    const char *track_save;     // 把加载的轨迹保存为二进制 .trk
+    double from;            // 起始时间戳，默认 60.0，希望跳过教室初期混乱
+    double duration;        // 持续时间，默认 60.，整节课，秒
+    struct Window {
+        double from, duration;
+        const char *box_fname;  // 为空时使用任务的框（-b/轨迹/检测）
+        int index;              // 指定的顺序，用于输出前缀和错误信息
+    };
+    std::vector<Window> windows;    // 多个时间窗口一次解码，不为空时忽略 from/duration，
+                                    // 第 k 个指定的窗口输出前缀为 <out_prefix>-win<kk>
+    double win_gap;         // 窗口之间的间隔超过该秒数时 seek，否则继续解码并丢弃，默认 5
+    int target_width, target_height; // 目标视频大小，默认 320 x 240
+    std::vector<std::pair<int, int>> levels;    // 额外的输出大小，不大于目标大小，同一次解码/crop 中缩放得到
+                                                // 输出前缀为 <out_prefix>-<w>x<h>
+    double fps;             // 输出帧率，默认 0 保持输入帧率，crop 之前丢帧
+    int max_person_cnt;     // 最多人数，按 score 取前 N 个，默认 0 不限制
+    float nms_iou;          // IoU 超过该值的框只保留 score 最大的，默认 0.7，0 不去重
+    float share_iou;        // IoU 不小于该值的框共用一次 crop，默认 0.9，0 不共用
+    int debug;              // 是否输出更多信息 ...
+    int verbose;            // 输出运行过程（DEBUG、开始/结束），默认 1；库接口只在 debug 时输出
+    double progress;        // 进度输出间隔秒数，默认 1，0 不输出
+    int report;             // 结束时输出运行报告 <out_prefix>-report.json
+    std::string out_prefix; // 输出文件名前缀，默认 crop
+    int fragmented;         // 视频输出为 fragmented mp4，处理过程中即可读取
+    double segment;         // > 0: 每个框按 segment 秒分段输出 (hls fmp4 + .m3u8)，关键帧与分段对齐
+    const char *mux;        // 不为空: 所有框写入同一个容器 <out_prefix>-crops.<mux>，每个框一路视频流
+    int mosaic;             // 所有框拼图后输出到 <out_prefix>-mosaic.mp4，同时生成 .tiles 索引
+    int tensor;             // 不编码，输出为张量文件 <out_prefix>-clip<NNNN>.tensor
+    TensorConfig tensor_cfg;
+    const char *shm_name;   // 不编码，发布到共享内存环形缓冲区，如 /crop_vid
+    int shm_slots;          // 共享内存帧数，默认 64
+    int shm_block;          // 缓冲区满时等待读端，默认 0 覆盖旧帧
+    int threads;            // 编码线程数，默认 0 单线程执行，> 0 使用流水线
+    int mem_budget;         // 内存预算 MB，> 0 时编码器单线程低延迟、延迟打开，框数和队列按预算限制
+    FrameCrop::Backend crop_backend;    // crop 实现: filter (默认) / native
+    DecConfig dec;          // 解码线程数、线程类型、快速解码
+    DetConfig det;          // det.model 不为空时检测人得到框，忽略 box_fname
+    GateConfig gate;        // gate.threshold > 0 时视频文件输出跳过静止帧（可变帧率）
+    double ext_left, ext_right, ext_top;    // 左右上扩展比例, 默认 0.3 0.3 0.4
+                                            // 左右使用框宽度扩展，上使用高度
+                                            // 如 ext_left = 0.3 对应向左扩展 0.3倍宽度
+    const char *batch_fname;    // 批处理任务清单，每行: 视频 框文件 from duration 输出前缀
+    int budget;             // 批处理总线程数，默认 cpu 数；批处理/守护进程中为每个任务分到的线程数（-chunks 按它平分）
+    int batch_jobs;         // 批处理同时执行的任务数，默认 0 根据 budget 决定
+    const char *serve_path; // 守护进程模式: 监听的 Unix socket，任务线程数同 budget/batch_jobs
+    int serve_queue;        // 守护进程排队的任务数上限，默认 64
+    int chunks;             // > 1 时 [from, from + duration] 按关键帧分段并行处理，再无损拼接，默认 1
+    double stamp_origin;    // 输出时间戳起点，默认 -1 取第一帧（分段处理内部使用）
+    // 库接口使用
+    std::vector<Box> boxes; // 不为空时直接使用（未扩展），忽略 box_fname/track_fname
+    // 不为空时由调用者创建输出（已 open），run_job 负责 close 和 delete；每级输出大小调用一次
+    std::function<CropOutput *(const std::vector<Box> &boxes, int width, int height, double fps)> make_output;
+    // 守护进程使用: 不为空时进度（帧数、时间戳、帧率）交给回调，间隔为 progress 秒
+    std::function<void(int64_t frames, double stamp, double fps)> on_progress;
+    // 不为空时运行报告（json）交给回调，report 为 0 也调用
+    std::function<void(const std::string &json)> on_report;
+#ifdef WITH_TEA
+    bool tea_enable;
+    const char *tea_model_path;         // tea 模型目录
+#endif // tea
+};
+
+/// 默认参数，与命令行不指定时相同
+void init_opts(Opts *opts);
+
+std::vector<Box> load_boxes_from_file(const Opts &opts);
+/// 按 ext_left/ext_right/ext_top 扩展框，扩展后可能越界
+Box extend_box(const Opts &opts, const Box &box);
+
+/// 从 input 当前位置取 opts.det.frames 帧检测人，返回未扩展的框（各帧合并，未去重）
+/// 期间解码的帧缓存后放回 input，之后从第一帧重新取出，不需要再次解码
+int detect_boxes(const Opts &opts, VideoDec *input, std::vector<Box> &boxes);
+
+/// 执行一次裁剪任务: 解码 opts.inp_fname 中 [from, from + duration)，每个框输出一个视频
+/// files 不为空时返回输出的视频文件（按框的顺序）
+/// 返回 0 成功，1 没有框，< 0 失败
+int run_job(const Opts &opts, std::vector<std::string> *files = nullptr);
+
+#endif // job.hxx
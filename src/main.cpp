@@ -1,6 +1,9 @@
 #include <stdio.h>
 #include <string>
-#include "media.hxx"
+#include "job.hxx"
+#include "batch.hxx"
+#include "server.hxx"
+#include "chunk.hxx"
 #include <chrono>
 #include <thread>
 #ifdef WITH_TEA
@@ -10,80 +13,19 @@
 
 using namespace std::chrono_literals;
 
-struct Opts {
-    std::string inp_fname;  // 输入视频文件名字
-    const char *box_fname;  // 框描述文件
-    double from;            // 起始时间戳，默认 60.0，希望跳过教室初期混乱
-    double duration;        // 持续时间，默认 60.，整节课，秒
-    int target_width, target_height; // 目标视频大小，默认 320 x 240
-    int max_person_cnt;         // 最多人数，默认 10
-    int debug;              // 是否输出更多信息 ...
-    double ext_left, ext_right, ext_top;    // 左右上扩展比例, 默认 0.3 0.3 0.4
-                                            // 左右使用框宽度扩展，上使用高度
-                                            // 如 ext_left = 0.3 对应向左扩展 0.3倍宽度
-#ifdef WITH_TEA
-    bool tea_enable;
-    const char *tea_model_path;         // tea 模型目录
-#endif // tea
-};
-
 static Opts _opts;
 
-static std::vector<Box> load_boxes_from_file(const char *fname) {
-    const char *_title[] = {
-        "standup", "writing", "reading", "raise_hand", "wait", "sitback",
-        "p_screen", "p_bb", "write_bb", "head", "head_table", "face_raise",
-        "back_standup",
-    };
-    // 文件每行一个 box，分别为 x1 y1 x2 y2\n
-    // 
-    FILE *fp = fopen(fname, "r");
-    if (!fp) {
-        fprintf(stderr, "ERR: %s:%d cannot open boxes file;%s\n", __func__, __LINE__, fname);
-        return {};
-    }
-
-    std::vector<Box> boxes;
-    while (!feof(fp)) {
-        int x1, y1, x2, y2, cls;
-        double score;
-        int rc = fscanf(fp, "%d %d %d %d %f %d\n", &x1, &y1, &x2, &y2, &score, &cls);
-        if (rc == 6) {
-            int w = x2 - x1, h = y2 - y1;
-            if (w <= 0 || h <= 0) {
-                fprintf(stderr, "WARN: %s:%d invalid box: %d,%d,%d,%d\n", __func__, __LINE__,
-                    x1, y1, x2, y2);
-            }
-            else {
-                // FIXME: 应该检查是否越界
-                x1 -= w * _opts.ext_left;
-                x2 += w * _opts.ext_right;
-                y1 -= h * _opts.ext_top;
-                boxes.push_back({x1, y1, x2, y2, _title[cls], score});
-            }
-        }
-    }
-
-    fclose(fp);
-
-    return boxes;
-}
-
 static int parse_opts(Opts *opts, int argc, char **argv) {
-    // app inp_fname -b box_fname -f from -d duration -w target_width -h target_height -N max_person_cnt -v
-    opts->box_fname = "act_box.txt";
-    opts->from = 60.0;
-    opts->duration = 60.0;
-    opts->target_width = 320;
-    opts->target_height = 240;
-    opts->debug = 0;
-    opts->ext_left = 0.3;
-    opts->ext_right = 0.3;
-    opts->ext_top = 0.2;
-#ifdef WITH_TEA
-    opts->tea_model_path = 0;
-    opts->tea_enable = false;
-#endif // tea
+    // app inp_fname -b box_fname -f from -d duration -win from,duration[,box_fname] -win_gap sec -w target_width -h target_height -levels WxH,WxH -fps fps -N max_person_cnt -nms iou -share iou -j threads -crop filter|native
+    //      -dec_threads n -dec_thread_type frame|slice|auto -dec_fast -index -follow sec
+    //      -track track_fname -track_save trk_fname
+    //      -det model -det_config cfg -det_size n -det_conf v -det_cls n -det_frames n -det_interval sec -det_norm scale,mean -det_rgb
+    //      -o out_prefix -mux mp4|mkv|mov -mosaic -frag -segment sec -gate v -gate_max sec -gate_scale n
+    //      -shm name -shm_slots n -shm_block
+    //      -tensor -tensor_len n -tensor_stride n -tensor_fmt rgb|bgr|gray -tensor_f32 -tensor_mean a,b,c -tensor_std a,b,c
+    //      -chunks n -mem_budget MB
+    //      -batch batch_fname -budget threads -batch_jobs n -serve sock_path -serve_queue n -progress sec -report -v
+    init_opts(opts);
 
     int curr = 0;
     while (++curr < argc) {
@@ -107,6 +49,26 @@ static int parse_opts(Opts *opts, int argc, char **argv) {
                 return -1;
             }
         }
+        else if (strcmp(argv[curr], "-track") == 0) {
+            if (curr + 1 < argc) {
+                opts->track_fname = argv[curr+1];
+                curr += 1;
+            }
+            else {
+                fprintf(stderr, "ERR: %s:%d no track_fname value\n", __func__, __LINE__);
+                return -1;
+            }
+        }
+        else if (strcmp(argv[curr], "-track_save") == 0) {
+            if (curr + 1 < argc) {
+                opts->track_save = argv[curr+1];
+                curr += 1;
+            }
+            else {
+                fprintf(stderr, "ERR: %s:%d no track_save value\n", __func__, __LINE__);
+                return -1;
+            }
+        }
         else if (strcmp(argv[curr], "-d") == 0) {
             if (curr + 1 < argc) {
                 opts->duration = atof(argv[curr+1]);
@@ -137,6 +99,134 @@ static int parse_opts(Opts *opts, int argc, char **argv) {
                 return -1;
             }
         }
+        else if (strcmp(argv[curr], "-det") == 0) {
+            if (curr + 1 < argc) {
+                opts->det.model = argv[curr+1];
+                curr += 1;
+            }
+            else {
+                fprintf(stderr, "ERR: %s:%d no det model value\n", __func__, __LINE__);
+                return -1;
+            }
+        }
+        else if (strcmp(argv[curr], "-det_config") == 0) {
+            if (curr + 1 < argc) {
+                opts->det.config = argv[curr+1];
+                curr += 1;
+            }
+            else {
+                fprintf(stderr, "ERR: %s:%d no det config value\n", __func__, __LINE__);
+                return -1;
+            }
+        }
+        else if (strcmp(argv[curr], "-det_size") == 0 || strcmp(argv[curr], "-det_cls") == 0 ||
+                strcmp(argv[curr], "-det_frames") == 0) {
+            if (curr + 1 < argc) {
+                int *v = strcmp(argv[curr], "-det_size") == 0 ? &opts->det.size :
+                    strcmp(argv[curr], "-det_cls") == 0 ? &opts->det.cls : &opts->det.frames;
+                *v = atoi(argv[curr+1]);
+                curr += 1;
+            }
+            else {
+                fprintf(stderr, "ERR: %s:%d no %s value\n", __func__, __LINE__, argv[curr]);
+                return -1;
+            }
+        }
+        else if (strcmp(argv[curr], "-det_conf") == 0) {
+            if (curr + 1 < argc) {
+                opts->det.conf = atof(argv[curr+1]);
+                curr += 1;
+            }
+            else {
+                fprintf(stderr, "ERR: %s:%d no det conf value\n", __func__, __LINE__);
+                return -1;
+            }
+        }
+        else if (strcmp(argv[curr], "-det_interval") == 0) {
+            if (curr + 1 < argc) {
+                opts->det.interval = atof(argv[curr+1]);
+                curr += 1;
+            }
+            else {
+                fprintf(stderr, "ERR: %s:%d no det interval value\n", __func__, __LINE__);
+                return -1;
+            }
+        }
+        else if (strcmp(argv[curr], "-det_norm") == 0) {
+            if (curr + 1 < argc && sscanf(argv[curr+1], "%lf,%lf", &opts->det.scale, &opts->det.mean) == 2) {
+                curr += 1;
+            }
+            else {
+                fprintf(stderr, "ERR: %s:%d -det_norm need 2 values: scale,mean\n", __func__, __LINE__);
+                return -1;
+            }
+        }
+        else if (strcmp(argv[curr], "-det_rgb") == 0) {
+            opts->det.rgb = true;
+        }
+        else if (strcmp(argv[curr], "-frag") == 0) {
+            opts->fragmented = 1;
+        }
+        else if (strcmp(argv[curr], "-segment") == 0) {
+            if (curr + 1 < argc) {
+                opts->segment = atof(argv[curr+1]);
+                curr += 1;
+            }
+            else {
+                fprintf(stderr, "ERR: %s:%d no segment value\n", __func__, __LINE__);
+                return -1;
+            }
+        }
+        else if (strcmp(argv[curr], "-gate") == 0) {
+            if (curr + 1 < argc) {
+                opts->gate.threshold = atof(argv[curr+1]);
+                curr += 1;
+            }
+            else {
+                fprintf(stderr, "ERR: %s:%d no gate value\n", __func__, __LINE__);
+                return -1;
+            }
+        }
+        else if (strcmp(argv[curr], "-gate_max") == 0) {
+            if (curr + 1 < argc) {
+                opts->gate.max_gap = atof(argv[curr+1]);
+                curr += 1;
+            }
+            else {
+                fprintf(stderr, "ERR: %s:%d no gate_max value\n", __func__, __LINE__);
+                return -1;
+            }
+        }
+        else if (strcmp(argv[curr], "-gate_scale") == 0) {
+            if (curr + 1 < argc) {
+                opts->gate.scale = atoi(argv[curr+1]);
+                curr += 1;
+            }
+            else {
+                fprintf(stderr, "ERR: %s:%d no gate_scale value\n", __func__, __LINE__);
+                return -1;
+            }
+        }
+        else if (strcmp(argv[curr], "-levels") == 0) {
+            if (curr + 1 < argc) {
+                // 224x224,112x112
+                opts->levels.clear();
+                for (const char *p = argv[curr+1]; p; p = strchr(p, ',') ? strchr(p, ',') + 1 : 0) {
+                    int w, h;
+                    // YUV420P 编码要求宽高为正偶数
+                    if (sscanf(p, "%dx%d", &w, &h) != 2 || w <= 0 || h <= 0 || w % 2 || h % 2) {
+                        fprintf(stderr, "ERR: %s:%d invalid levels: %s\n", __func__, __LINE__, argv[curr+1]);
+                        return -1;
+                    }
+                    opts->levels.push_back({ w, h });
+                }
+                curr += 1;
+            }
+            else {
+                fprintf(stderr, "ERR: %s:%d no levels value\n", __func__, __LINE__);
+                return -1;
+            }
+        }
         else if (strcmp(argv[curr], "-N") == 0) {
             if (curr + 1 < argc) {
                 opts->max_person_cnt = atoi(argv[curr+1]);
@@ -147,6 +237,253 @@ static int parse_opts(Opts *opts, int argc, char **argv) {
                 return -1;
             }
         }
+        else if (strcmp(argv[curr], "-j") == 0) {
+            if (curr + 1 < argc) {
+                opts->threads = atoi(argv[curr+1]);
+                curr += 1;
+            }
+            else {
+                fprintf(stderr, "ERR: %s:%d no threads value\n", __func__, __LINE__);
+                return -1;
+            }
+        }
+        else if (strcmp(argv[curr], "-crop") == 0) {
+            if (curr + 1 < argc) {
+                if (strcmp(argv[curr+1], "native") == 0) {
+                    opts->crop_backend = FrameCrop::NATIVE;
+                }
+                else if (strcmp(argv[curr+1], "filter") == 0) {
+                    opts->crop_backend = FrameCrop::FILTER;
+                }
+                else {
+                    fprintf(stderr, "ERR: %s:%d unknown crop backend: %s\n", __func__, __LINE__, argv[curr+1]);
+                    return -1;
+                }
+                curr += 1;
+            }
+            else {
+                fprintf(stderr, "ERR: %s:%d no crop backend value\n", __func__, __LINE__);
+                return -1;
+            }
+        }
+        else if (strcmp(argv[curr], "-dec_threads") == 0) {
+            if (curr + 1 < argc) {
+                opts->dec.threads = atoi(argv[curr+1]);
+                curr += 1;
+            }
+            else {
+                fprintf(stderr, "ERR: %s:%d no dec_threads value\n", __func__, __LINE__);
+                return -1;
+            }
+        }
+        else if (strcmp(argv[curr], "-dec_thread_type") == 0) {
+            if (curr + 1 < argc) {
+                if (strcmp(argv[curr+1], "frame") == 0) {
+                    opts->dec.thread_type = FF_THREAD_FRAME;
+                }
+                else if (strcmp(argv[curr+1], "slice") == 0) {
+                    opts->dec.thread_type = FF_THREAD_SLICE;
+                }
+                else if (strcmp(argv[curr+1], "auto") == 0) {
+                    opts->dec.thread_type = FF_THREAD_FRAME | FF_THREAD_SLICE;
+                }
+                else {
+                    fprintf(stderr, "ERR: %s:%d unknown dec_thread_type: %s\n", __func__, __LINE__, argv[curr+1]);
+                    return -1;
+                }
+                curr += 1;
+            }
+            else {
+                fprintf(stderr, "ERR: %s:%d no dec_thread_type value\n", __func__, __LINE__);
+                return -1;
+            }
+        }
+        else if (strcmp(argv[curr], "-dec_fast") == 0) {
+            opts->dec.fast = true;
+        }
+        else if (strcmp(argv[curr], "-index") == 0) {
+            opts->dec.index = true;
+        }
+        else if (strcmp(argv[curr], "-win") == 0) {
+            Opts::Window win = { 0, 0, nullptr, (int)opts->windows.size() };
+            if (curr + 1 < argc && sscanf(argv[curr+1], "%lf,%lf", &win.from, &win.duration) == 2 && win.duration > 0) {
+                // 第三项为该窗口的框文件，指向 argv 中的字符串
+                const char *p = strchr(strchr(argv[curr+1], ',') + 1, ',');
+                if (p && p[1]) win.box_fname = p + 1;
+                opts->windows.push_back(win);
+                curr += 1;
+            }
+            else {
+                fprintf(stderr, "ERR: %s:%d -win need from,duration[,box_fname]\n", __func__, __LINE__);
+                return -1;
+            }
+        }
+        else if (strcmp(argv[curr], "-win_gap") == 0) {
+            if (curr + 1 < argc) {
+                opts->win_gap = atof(argv[curr+1]);
+                curr += 1;
+            }
+            else {
+                fprintf(stderr, "ERR: %s:%d no win_gap value\n", __func__, __LINE__);
+                return -1;
+            }
+        }
+        else if (strcmp(argv[curr], "-o") == 0) {
+            if (curr + 1 < argc) {
+                opts->out_prefix = argv[curr+1];
+                curr += 1;
+            }
+            else {
+                fprintf(stderr, "ERR: %s:%d no out_prefix value\n", __func__, __LINE__);
+                return -1;
+            }
+        }
+        else if (strcmp(argv[curr], "-mux") == 0) {
+            if (curr + 1 < argc) {
+                opts->mux = argv[curr+1];
+                curr += 1;
+            }
+            else {
+                fprintf(stderr, "ERR: %s:%d no mux container\n", __func__, __LINE__);
+                return -1;
+            }
+        }
+        else if (strcmp(argv[curr], "-mosaic") == 0) {
+            opts->mosaic = 1;
+        }
+        else if (strcmp(argv[curr], "-tensor") == 0) {
+            opts->tensor = 1;
+        }
+        else if (strcmp(argv[curr], "-shm") == 0) {
+            if (curr + 1 < argc) {
+                opts->shm_name = argv[curr+1];
+                curr += 1;
+            }
+            else {
+                fprintf(stderr, "ERR: %s:%d no shm name\n", __func__, __LINE__);
+                return -1;
+            }
+        }
+        else if (strcmp(argv[curr], "-shm_slots") == 0) {
+            if (curr + 1 < argc) {
+                opts->shm_slots = atoi(argv[curr+1]);
+                curr += 1;
+            }
+            else {
+                fprintf(stderr, "ERR: %s:%d no shm_slots value\n", __func__, __LINE__);
+                return -1;
+            }
+        }
+        else if (strcmp(argv[curr], "-shm_block") == 0) {
+            opts->shm_block = 1;
+        }
+        else if (strcmp(argv[curr], "-tensor_len") == 0) {
+            if (curr + 1 < argc) {
+                opts->tensor_cfg.len = atoi(argv[curr+1]);
+                curr += 1;
+            }
+            else {
+                fprintf(stderr, "ERR: %s:%d no tensor_len value\n", __func__, __LINE__);
+                return -1;
+            }
+        }
+        else if (strcmp(argv[curr], "-tensor_stride") == 0) {
+            if (curr + 1 < argc) {
+                opts->tensor_cfg.stride = atoi(argv[curr+1]);
+                curr += 1;
+            }
+            else {
+                fprintf(stderr, "ERR: %s:%d no tensor_stride value\n", __func__, __LINE__);
+                return -1;
+            }
+        }
+        else if (strcmp(argv[curr], "-tensor_fmt") == 0) {
+            if (curr + 1 < argc) {
+                if (strcmp(argv[curr+1], "rgb") == 0) {
+                    opts->tensor_cfg.channels = 3;
+                    opts->tensor_cfg.bgr = false;
+                }
+                else if (strcmp(argv[curr+1], "bgr") == 0) {
+                    opts->tensor_cfg.channels = 3;
+                    opts->tensor_cfg.bgr = true;
+                }
+                else if (strcmp(argv[curr+1], "gray") == 0) {
+                    opts->tensor_cfg.channels = 1;
+                }
+                else {
+                    fprintf(stderr, "ERR: %s:%d unknown tensor_fmt: %s\n", __func__, __LINE__, argv[curr+1]);
+                    return -1;
+                }
+                curr += 1;
+            }
+            else {
+                fprintf(stderr, "ERR: %s:%d no tensor_fmt value\n", __func__, __LINE__);
+                return -1;
+            }
+        }
+        else if (strcmp(argv[curr], "-tensor_f32") == 0) {
+            opts->tensor_cfg.f32 = true;
+        }
+        else if (strcmp(argv[curr], "-tensor_mean") == 0 || strcmp(argv[curr], "-tensor_std") == 0) {
+            float *v = strcmp(argv[curr], "-tensor_mean") == 0 ? opts->tensor_cfg.mean : opts->tensor_cfg.std;
+            if (curr + 1 < argc && sscanf(argv[curr+1], "%f,%f,%f", &v[0], &v[1], &v[2]) == 3) {
+                curr += 1;
+            }
+            else {
+                fprintf(stderr, "ERR: %s:%d %s need 3 values: a,b,c\n", __func__, __LINE__, argv[curr]);
+                return -1;
+            }
+        }
+        else if (strcmp(argv[curr], "-batch") == 0) {
+            if (curr + 1 < argc) {
+                opts->batch_fname = argv[curr+1];
+                curr += 1;
+            }
+            else {
+                fprintf(stderr, "ERR: %s:%d no batch_fname value\n", __func__, __LINE__);
+                return -1;
+            }
+        }
+        else if (strcmp(argv[curr], "-budget") == 0) {
+            if (curr + 1 < argc) {
+                opts->budget = atoi(argv[curr+1]);
+                curr += 1;
+            }
+            else {
+                fprintf(stderr, "ERR: %s:%d no budget value\n", __func__, __LINE__);
+                return -1;
+            }
+        }
+        else if (strcmp(argv[curr], "-batch_jobs") == 0) {
+            if (curr + 1 < argc) {
+                opts->batch_jobs = atoi(argv[curr+1]);
+                curr += 1;
+            }
+            else {
+                fprintf(stderr, "ERR: %s:%d no batch_jobs value\n", __func__, __LINE__);
+                return -1;
+            }
+        }
+        else if (strcmp(argv[curr], "-serve") == 0) {
+            if (curr + 1 < argc) {
+                opts->serve_path = argv[curr+1];
+                curr += 1;
+            }
+            else {
+                fprintf(stderr, "ERR: %s:%d no serve socket path\n", __func__, __LINE__);
+                return -1;
+            }
+        }
+        else if (strcmp(argv[curr], "-serve_queue") == 0) {
+            if (curr + 1 < argc) {
+                opts->serve_queue = atoi(argv[curr+1]);
+                curr += 1;
+            }
+            else {
+                fprintf(stderr, "ERR: %s:%d no serve_queue value\n", __func__, __LINE__);
+                return -1;
+            }
+        }
         else if (strcmp(argv[curr], "-ext_top") == 0) {
             if (curr + 1 < argc) {
                 opts->ext_top = atof(argv[curr+1]);
@@ -192,6 +529,70 @@ static int parse_opts(Opts *opts, int argc, char **argv) {
             }
         }
 #endif // tea
+        else if (strcmp(argv[curr], "-nms") == 0 || strcmp(argv[curr], "-share") == 0) {
+            if (curr + 1 < argc) {
+                float *v = strcmp(argv[curr], "-nms") == 0 ? &opts->nms_iou : &opts->share_iou;
+                *v = atof(argv[curr+1]);
+                curr += 1;
+            }
+            else {
+                fprintf(stderr, "ERR: %s:%d no %s value\n", __func__, __LINE__, argv[curr]);
+                return -1;
+            }
+        }
+        else if (strcmp(argv[curr], "-follow") == 0) {
+            if (curr + 1 < argc) {
+                opts->dec.follow = atof(argv[curr+1]);
+                curr += 1;
+            }
+            else {
+                fprintf(stderr, "ERR: %s:%d no follow value\n", __func__, __LINE__);
+                return -1;
+            }
+        }
+        else if (strcmp(argv[curr], "-mem_budget") == 0) {
+            if (curr + 1 < argc) {
+                opts->mem_budget = atoi(argv[curr+1]);
+                curr += 1;
+            }
+            else {
+                fprintf(stderr, "ERR: %s:%d no mem_budget value\n", __func__, __LINE__);
+                return -1;
+            }
+        }
+        else if (strcmp(argv[curr], "-chunks") == 0) {
+            if (curr + 1 < argc) {
+                opts->chunks = atoi(argv[curr+1]);
+                curr += 1;
+            }
+            else {
+                fprintf(stderr, "ERR: %s:%d no chunks value\n", __func__, __LINE__);
+                return -1;
+            }
+        }
+        else if (strcmp(argv[curr], "-fps") == 0) {
+            if (curr + 1 < argc) {
+                opts->fps = atof(argv[curr+1]);
+                curr += 1;
+            }
+            else {
+                fprintf(stderr, "ERR: %s:%d no fps value\n", __func__, __LINE__);
+                return -1;
+            }
+        }
+        else if (strcmp(argv[curr], "-progress") == 0) {
+            if (curr + 1 < argc) {
+                opts->progress = atof(argv[curr+1]);
+                curr += 1;
+            }
+            else {
+                fprintf(stderr, "ERR: %s:%d no progress value\n", __func__, __LINE__);
+                return -1;
+            }
+        }
+        else if (strcmp(argv[curr], "-report") == 0) {
+            opts->report = 1;
+        }
         else if (strcmp(argv[curr], "-v") == 0) {
             opts->debug = 1;
         }
@@ -204,14 +605,90 @@ static int parse_opts(Opts *opts, int argc, char **argv) {
         }
     }
 
+    if (opts->mux && opts->segment > 0) {
+        fprintf(stderr, "ERR: %s:%d -mux does not support -segment\n", __func__, __LINE__);
+        return -1;
+    }
+    if (opts->mosaic && opts->segment > 0) {
+        fprintf(stderr, "ERR: %s:%d -mosaic does not support -segment\n", __func__, __LINE__);
+        return -1;
+    }
+    if (!opts->windows.empty()) {
+        // 多窗口的输出按窗口分文件，不能再按时间切分或合成一个容器
+        if (opts->mux || opts->segment > 0) {
+            fprintf(stderr, "ERR: %s:%d -win does not support -mux/-segment\n", __func__, __LINE__);
+            return -1;
+        }
+        if (opts->threads > 0) {
+            fprintf(stderr, "WARN: %s:%d -win runs crop and encode in the decode thread, -j ignored\n", __func__, __LINE__);
+        }
+        if (opts->chunks > 1) {
+            fprintf(stderr, "WARN: %s:%d -win decodes once, -chunks ignored\n", __func__, __LINE__);
+            opts->chunks = 1;
+        }
+    }
+
     if (opts->debug) {
         fprintf(stdout, "DEBUG: using opts\n");
         fprintf(stderr, "    inp fname: %s\n", opts->inp_fname.c_str());
         fprintf(stdout, "    boxes fnmae: %s\n", opts->box_fname);
+        if (opts->track_fname) {
+            fprintf(stdout, "    track fname: %s\n", opts->track_fname);
+        }
+        if (opts->det.model) {
+            const DetConfig &d = opts->det;
+            fprintf(stdout, "    det model: %s, config: %s\n", d.model, d.config ? d.config : "");
+            fprintf(stdout, "    det size %d, conf %.2f, cls %d, frames %d, interval %.1f, scale %f, mean %.1f, rgb %d\n",
+                    d.size, d.conf, d.cls, d.frames, d.interval, d.scale, d.mean, d.rgb);
+        }
         fprintf(stdout, "    from: %.03f\n", opts->from);
         fprintf(stderr, "    duration: %.01f\n", opts->duration);
+        for (auto &w: opts->windows) {
+            fprintf(stderr, "    window #%02d: %.03f + %.01f, boxes: %s\n", w.index, w.from, w.duration,
+                    w.box_fname ? w.box_fname : "-");
+        }
+        if (!opts->windows.empty()) {
+            fprintf(stderr, "    window gap: %.1f\n", opts->win_gap);
+        }
         fprintf(stderr, "    target size: %d x %d\n", opts->target_width, opts->target_height);
-        fprintf(stderr, "    max person cnt: %d\n", opts->max_person_cnt);
+        for (auto &l: opts->levels) {
+            fprintf(stderr, "    level: %d x %d\n", l.first, l.second);
+        }
+        fprintf(stderr, "    fps: %.2f\n", opts->fps);
+        fprintf(stderr, "    max person cnt: %d, nms iou: %.2f, share iou: %.2f\n",
+                opts->max_person_cnt, opts->nms_iou, opts->share_iou);
+        fprintf(stderr, "    out prefix: %s\n", opts->out_prefix.c_str());
+        if (opts->mux) {
+            fprintf(stderr, "    mux: %s-crops.%s\n", opts->out_prefix.c_str(), opts->mux);
+        }
+        fprintf(stderr, "    mosaic: %d, fragmented: %d, segment: %.1f\n", opts->mosaic, opts->fragmented, opts->segment);
+        if (opts->gate.threshold > 0) {
+            fprintf(stderr, "    gate: %.2f, max gap %.1f, scale %d (sad: %s)\n",
+                    opts->gate.threshold, opts->gate.max_gap, opts->gate.scale, sad_impl_name());
+        }
+        fprintf(stderr, "    progress: %.1f, report: %d\n", opts->progress, opts->report);
+        fprintf(stderr, "    chunks: %d, follow: %.1f\n", opts->chunks, opts->dec.follow);
+        if (opts->shm_name) {
+            fprintf(stderr, "    shm: %s, slots %d, block %d\n", opts->shm_name, opts->shm_slots, opts->shm_block);
+        }
+        if (opts->tensor) {
+            const TensorConfig &t = opts->tensor_cfg;
+            fprintf(stderr, "    tensor: len %d, stride %d, channels %d, bgr %d, f32 %d\n",
+                    t.len, t.stride, t.channels, t.bgr, t.f32);
+        }
+        fprintf(stderr, "    threads: %d, mem budget: %d MB\n", opts->threads, opts->mem_budget);
+        if (opts->batch_fname) {
+            fprintf(stderr, "    batch fname: %s, budget: %d, jobs: %d\n",
+                    opts->batch_fname, opts->budget, opts->batch_jobs);
+        }
+        if (opts->serve_path) {
+            fprintf(stderr, "    serve: %s, budget: %d, jobs: %d, queue: %d\n",
+                    opts->serve_path, opts->budget, opts->batch_jobs, opts->serve_queue);
+        }
+        fprintf(stderr, "    dec threads: %d, thread type: %d, fast: %d, index: %d\n",
+                opts->dec.threads, opts->dec.thread_type, opts->dec.fast, opts->dec.index);
+        fprintf(stderr, "    crop backend: %s (resize: %s)\n",
+                opts->crop_backend == FrameCrop::NATIVE ? "native" : "filter", PlaneResizer::impl_name());
         fprintf(stderr, "    ext left/right/top: %.02f/%.02f/%.02f\n",
                 opts->ext_left, opts->ext_right, opts->ext_top);
 #ifdef WITH_TEA
@@ -223,12 +700,11 @@ static int parse_opts(Opts *opts, int argc, char **argv) {
     return 0;
 }
 
-
 int main(int argc, char **argv) {
     if (parse_opts(&_opts, argc, argv) < 0) {
         return -1;
     }
-    if (_opts.inp_fname.empty()) {
+    if (_opts.inp_fname.empty() && !_opts.batch_fname && !_opts.serve_path) {
         fprintf(stderr, "ERR: %s:%d NO inp video?\n", __func__, __LINE__);
         return -1;
     }
@@ -244,100 +720,29 @@ int main(int argc, char **argv) {
     }
 #endif // tea
 
-    if (!_opts.box_fname) {
-        fprintf(stdout, "WARN: no boxes fname, using default: {300, 400, 700, 700}\n");
-    }
-
-    VideoDec input;
-    int rc = input.open(_opts.inp_fname.c_str());
-    if (rc < 0) {
-        fprintf(stderr, "ERR: %s:%s cannot open input fname:%s\n", __func__, __LINE__, _opts.inp_fname.c_str());
-        return -1;
-    }
-
-    double duration = input.get_duration();
-    fprintf(stdout, "DEBUG: duration: %.03f seconds\n", duration);
-
-    input.seek(_opts.from);
-
-    double stamp;
-    AVFrame *frame;
-
-    // 第一帧，需要进行目标检测 ...
-    rc = input.get_frame(&stamp, &frame);
-    if (rc <= 0) {
-        fprintf(stderr, "ERR: %s:%d no any valid picture!!!\n", __func__, __LINE__);
-        return -1;
-    }
-
-    // TODO: 通过目标检测 ... 
-    std::vector<Box> boxes = 
-        _opts.box_fname ? load_boxes_from_file(_opts.box_fname) : 
-        std::vector<Box>({ {300, 400, 700, 700, "none", 0.0} });
-
-    if (boxes.empty()) {
-        fprintf(stderr, "WARNING: no boxes from %s\n", _opts.box_fname);
-        return 1;
-    }
-
-    // 扣图
-    FrameCrop cropper;
-    rc = cropper.open(frame->width, frame->height, (AVPixelFormat)frame->format,
-            boxes, _opts.target_width, _opts.target_height);
-
-    // 压缩为文件存储
-    std::vector<VideoEnc *> encoders;
-    for (int i = 0; i < boxes.size(); i++) {
-        char fname[256];
-        snprintf(fname, sizeof(fname), "crop-%s-%d_%d.mp4", boxes[i].title, boxes[i].x1, boxes[i].y1);
-        auto enc = new VideoEnc;
-        enc->open(fname, _opts.target_width, _opts.target_height);
-        encoders.push_back(enc);
-    }
-
-    int frame_cnt = 0;
-    fprintf(stdout, "begin crop from %.03f vs %.03f==>\n", _opts.from, stamp);
-    while (stamp + 0.04 <= _opts.from + _opts.duration) {
-        frame_cnt ++;
-        fprintf(stdout, "    => put frame #%05d: from %.03f - %.03f seconds..\r", 
-            frame_cnt, _opts.from, stamp);
-
-        if (cropper.put(frame) >= 0) {
-            std::vector<AVFrame *> cropped_frames = cropper.get();
-            for (int j = 0; j < cropped_frames.size(); j++) {
-                if (cropped_frames[j]) {
-                    AVFrame *cf = cropped_frames[j];
-                    encoders[j]->put_frame(stamp, cf);
-                    av_frame_unref(cf);
-                }
-            }
-        }
-
-        av_frame_unref(frame);
-
-        // 下一帧 ..
-        rc = input.get_frame(&stamp, &frame);
+    int rc;
+    if (_opts.serve_path) {
+        // 每个任务的参数单独解析，不继承守护进程的命令行
+        Server server;
+        rc = server.open(_opts.serve_path);
         if (rc == 0) {
-            fprintf(stdout, "DEBUG: EOF, done!!\n");
-            break;
+            rc = server.run(_opts.budget, _opts.batch_jobs, _opts.serve_queue, parse_opts);
         }
-        else if (rc < 0) {
-            fprintf(stderr, "ERR: rc=%d\n", rc);
-            break;
+    }
+    else if (_opts.batch_fname) {
+        Batch batch;
+        rc = batch.load(_opts.batch_fname, _opts);
+        if (rc >= 0) {
+            rc = batch.run(_opts.budget, _opts.batch_jobs);
         }
     }
-    fprintf(stderr, "\n All done\n");
-
-    for (auto enc: encoders) {
-        enc->close();
-        delete enc;
+    else {
+        rc = run_chunked(_opts);
     }
-    cropper.close();
-    input.close();
 
 #ifdef WITH_TEA
     delete pipe;
 #endif // 
 
-    return 0;
+    return rc;
 }
@@ -1,4 +1,12 @@
 #include "media.hxx"
+
+#include <math.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
 extern "C" {
 #   include <libavfilter/buffersrc.h>
 #   include <libavfilter/buffersink.h>
@@ -19,15 +27,39 @@ static Init _init;
 
 
 //////////////////////// dec
-int VideoDec::open(const char *fname) {
+int VideoDec::open(const char *fname, const DecConfig &cfg) {
     __fname = fname;
-    int rc = avformat_open_input(&__fc, fname, 0, 0);
+    bool use_index = cfg.index && cfg.follow <= 0 && !cfg.io;
+    if (use_index && __index.load(fname) < 0) {
+        if (__index.build(fname) == 0) {
+            __index.save();
+        }
+    }
+
+    int rc;
+    if (cfg.io) {
+        __fc = avformat_alloc_context();
+        __fc->pb = cfg.io;
+        __fc->flags |= AVFMT_FLAG_CUSTOM_IO;
+        rc = avformat_open_input(&__fc, fname, 0, 0);
+    }
+    else if (cfg.follow > 0) {
+        rc = __open_follow(fname, cfg.follow);
+    }
+    else {
+        rc = avformat_open_input(&__fc, fname, 0, 0);
+    }
     if (rc < 0) {
-        fprintf(stderr, "ERR: %s:%s cannot open fname:%s\n", __func__, __LINE__, fname);
+        fprintf(stderr, "ERR: %s:%d cannot open fname:%s\n", __func__, __LINE__, fname);
+        close();
         return -1;
     }
 
-    rc = avformat_find_stream_info(__fc, 0);
+    // 有索引时使用缓存的流参数，省去探测
+    __indexed = use_index && !__index.empty() && __index.apply(__fc) == 0;
+    if (!__indexed) {
+        rc = avformat_find_stream_info(__fc, 0);
+    }
 
     av_dump_format(__fc, -1, fname, 0);
 
@@ -38,9 +70,21 @@ int VideoDec::open(const char *fname) {
             if (c) {
                 __cc = avcodec_alloc_context3(c);
                 avcodec_parameters_to_context(__cc, stream->codecpar);
-                avcodec_open2(__cc, c, 0);
+                __cc->thread_count = cfg.threads;
+                __cc->thread_type = cfg.thread_type;
+                if (cfg.fast) {
+                    __cc->skip_loop_filter = AVDISCARD_NONREF;
+                    __cc->flags2 |= AV_CODEC_FLAG2_FAST;
+                }
+                __skip_frame = __cc->skip_frame;
+                rc = avcodec_open2(__cc, c, 0);
+                if (rc < 0) {
+                    fprintf(stderr, "ERR: %s:%d cannot open decoder for %s\n", __func__, __LINE__, fname);
+                    avcodec_free_context(&__cc);
+                    continue;
+                }
 
-                if (__fc->pb->seekable) {
+                if (__fc->pb->seekable && !__avio) {
                     __duration = 1.0 * stream->duration * stream->time_base.num / stream->time_base.den;
                 }
 
@@ -51,7 +95,7 @@ int VideoDec::open(const char *fname) {
     }
 
     if (!__cc) {
-        fprintf(stderr, "ERR: %s:%s cannot find video stream from %s\n", __func__, __LINE__, fname);
+        fprintf(stderr, "ERR: %s:%d cannot find video stream from %s\n", __func__, __LINE__, fname);
         avformat_close_input(&__fc);
         return -1;
     }
@@ -62,6 +106,76 @@ int VideoDec::open(const char *fname) {
     return 0;
 }
 
+void VideoDec::set_rate(double fps) {
+    __rate = fps;
+    __next_slot = INT64_MIN;
+    double inp = frame_rate();
+    __skip_nonref = fps > 0 && inp >= 2 * fps;
+    __skip_frame = __skip_nonref ? AVDISCARD_NONREF : AVDISCARD_DEFAULT;
+    if (__cc && __skip_until < 0) {
+        __cc->skip_frame = __skip_frame;
+    }
+}
+
+double VideoDec::frame_rate() const {
+    if (!__fc || __sid < 0) return 0.0;
+    AVStream *stream = __fc->streams[__sid];
+    AVRational r = stream->avg_frame_rate.num ? stream->avg_frame_rate : stream->r_frame_rate;
+    return r.den ? av_q2d(r) : 0.0;
+}
+
+AVRational VideoDec::time_base() const {
+    if (!__fc || __sid < 0) return { 1, 25 };
+    return __fc->streams[__sid]->time_base;
+}
+
+// 写入中的文件: 自定义读取，读到结尾时等待文件增长，不可 seek（避免探测时读文件尾）
+// 写入端需要使用流式格式（ts/flv/mkv/fragmented mp4），普通 mp4 的 moov 在文件尾
+int VideoDec::__open_follow(const char *fname, double timeout) {
+    __follow.fd = ::open(fname, O_RDONLY);
+    if (__follow.fd < 0) {
+        fprintf(stderr, "ERR: %s:%d cannot open %s\n", __func__, __LINE__, fname);
+        return -1;
+    }
+    struct stat st;
+    __follow.fifo = fstat(__follow.fd, &st) == 0 && S_ISFIFO(st.st_mode);
+    __follow.timeout = timeout;
+
+    const int size = 64 * 1024;
+    uint8_t *buf = (uint8_t *)av_malloc(size);
+    __avio = avio_alloc_context(buf, size, 0, &__follow, &VideoDec::__follow_read, 0, 0);
+    if (!__avio) {
+        av_free(buf);
+        return -1;
+    }
+    __avio->seekable = 0;
+
+    __fc = avformat_alloc_context();
+    __fc->pb = __avio;
+    __fc->flags |= AVFMT_FLAG_CUSTOM_IO;
+    return avformat_open_input(&__fc, fname, 0, 0);
+}
+
+int VideoDec::__follow_read(void *opaque, uint8_t *buf, int size) {
+    Follow *f = (Follow *)opaque;
+    double idle = 0.0;
+    for (;;) {
+        ssize_t n = read(f->fd, buf, size);
+        if (n > 0) {
+            return n;
+        }
+        if (n < 0 && errno != EINTR && errno != EAGAIN) {
+            return AVERROR(errno);
+        }
+        // FIFO 读到 0 表示写端已关闭
+        if (n == 0 && (f->fifo || idle >= f->timeout)) {
+            return AVERROR_EOF;
+        }
+        usleep(100000);
+        idle += 0.1;
+    }
+}
+
 int VideoDec::close() {
     if (__cc) {
         avcodec_close(__cc);
@@ -70,7 +184,19 @@ int VideoDec::close() {
     if (__fc) {
         avformat_close_input(&__fc);
     }
+    if (__avio) {
+        av_freep(&__avio->buffer);
+        avio_context_free(&__avio);
+    }
+    if (__follow.fd >= 0) {
+        ::close(__follow.fd);
+        __follow.fd = -1;
+    }
 
+    for (auto &p: __pending) {
+        av_frame_free(&p.second);
+    }
+    __pending.clear();
     av_packet_free(&__pkt);
     av_frame_free(&__frame);
 
@@ -81,13 +207,72 @@ double VideoDec::get_duration() {
     return __duration;
 }
 
+// 定位到 pos 之前最近的关键帧，之后 get_frame 丢弃 pos 之前的帧
 int VideoDec::seek(double pos) {
-    if (__fc) {
-        auto &ts = __fc->streams[__sid]->time_base;
-        int64_t stamp = (int64_t)(pos * ts.den / ts.num);
-        return av_seek_frame(__fc, __sid, stamp, AVSEEK_FLAG_ANY | AVSEEK_FLAG_BACKWARD);
+    if (!__fc) return -1;
+
+    for (auto &p: __pending) {
+        av_frame_free(&p.second);
+    }
+    __pending.clear();
+
+    // follow 模式和不可 seek 的自定义输入，从头解码并丢弃 pos 之前的帧
+    if ((__fc->flags & AVFMT_FLAG_CUSTOM_IO) && !__fc->pb->seekable) {
+        __skip_until = pos;
+        __cc->skip_frame = AVDISCARD_NONREF;
+        __next_slot = INT64_MIN;
+        return 0;
+    }
+
+    auto &ts = __fc->streams[__sid]->time_base;
+    int64_t stamp = (int64_t)(pos * ts.den / ts.num);
+    avcodec_flush_buffers(__cc);
+    __draining = false;
+
+    int rc;
+    const KeyIndex::Entry *key = __indexed ? __index.find(stamp) : nullptr;
+    if (key && key->pos >= 0 && !(__fc->iformat->flags & AVFMT_NO_BYTE_SEEK)) {
+        rc = av_seek_frame(__fc, __sid, key->pos, AVSEEK_FLAG_BYTE);
+    }
+    else {
+        rc = av_seek_frame(__fc, __sid, key ? key->pts : stamp, AVSEEK_FLAG_BACKWARD);
+    }
+    if (rc < 0) {
+        fprintf(stderr, "ERR: %s:%d seek to %.03f failed, rc=%d\n", __func__, __LINE__, pos, rc);
+        return rc;
+    }
+
+    // 丢弃阶段不需要非参考帧
+    __skip_until = pos;
+    __cc->skip_frame = AVDISCARD_NONREF;
+    __next_slot = INT64_MIN;
+    return rc;
+}
+
+bool VideoDec::seekable() const {
+    if (!__fc) return false;
+    return !(__fc->flags & AVFMT_FLAG_CUSTOM_IO) || (__fc->pb && __fc->pb->seekable);
+}
+
+void VideoDec::skip_to(double pos) {
+    if (!__cc) return;
+
+    // 放回的帧同样按时间丢弃
+    while (!__pending.empty() && __pending.front().first + 0.001 < pos) {
+        av_frame_free(&__pending.front().second);
+        __pending.pop_front();
     }
-    return -1;
+    __skip_until = pos;
+    __cc->skip_frame = AVDISCARD_NONREF;
+    __next_slot = INT64_MIN;
+}
+
+// 多线程解码时输出帧相对输入 packet 有延迟，时间戳必须取自 frame
+double VideoDec::__frame_stamp() {
+    int64_t pts = __frame->best_effort_timestamp;
+    if (pts == AV_NOPTS_VALUE)
+        pts = __frame->pts;
+    return 1.0 * pts * __fc->streams[__sid]->time_base.num / __fc->streams[__sid]->time_base.den;
 }
 
 int VideoDec::__try_get_frame(double *pos, AVFrame **pic) {
@@ -98,11 +283,21 @@ int VideoDec::__try_get_frame(double *pos, AVFrame **pic) {
     // 上次是否有遗留
     rc = avcodec_receive_frame(__cc, __frame);
     if (rc == 0) {
+        *pos = __frame_stamp();
         *pic = __frame;
         return 1;
     }
+    if (__draining) {
+        return rc == AVERROR(EAGAIN) ? 0 : rc;
+    }
 
     rc = av_read_frame(__fc, __pkt);
+    if (rc == AVERROR_EOF) {
+        // 送入空包，取出解码器中缓存的帧
+        __draining = true;
+        avcodec_send_packet(__cc, 0);
+        return 0;
+    }
     if (rc < 0)
         return rc;
 
@@ -111,14 +306,12 @@ int VideoDec::__try_get_frame(double *pos, AVFrame **pic) {
         return 0;
     }
 
-    // FIXME: 使用 frame 中，还是 packet 中的时间戳？
-    *pos = 1.0 * __pkt->pts * __fc->streams[__sid]->time_base.num / __fc->streams[__sid]->time_base.den;
-    
     rc = avcodec_send_packet(__cc, __pkt);
     av_packet_unref(__pkt);
 
     rc = avcodec_receive_frame(__cc, __frame);
     if (rc == 0) {
+        *pos = __frame_stamp();
         *pic = __frame;
         return 1;
     }
@@ -129,22 +322,90 @@ int VideoDec::__try_get_frame(double *pos, AVFrame **pic) {
 }
 
 int VideoDec::get_frame(double *pos, AVFrame **pic) {
-    int rc = __try_get_frame(pos, pic);
-    while (rc == 0)
+    if (!__pending.empty()) {
+        // 已经过 seek/丢帧的判断
+        AVFrame *frame = __pending.front().second;
+        *pos = __pending.front().first;
+        __pending.pop_front();
+        av_frame_unref(__frame);
+        av_frame_move_ref(__frame, frame);
+        av_frame_free(&frame);
+        *pic = __frame;
+        return 1;
+    }
+
+    int rc;
+    do {
         rc = __try_get_frame(pos, pic);
-    return rc;
+        if (rc > 0 && __skip_until >= 0) {
+            if (*pos + 0.001 < __skip_until) {
+                av_frame_unref(__frame);
+                rc = 0;
+            }
+            else {
+                __skip_until = -1.0;
+                __cc->skip_frame = __skip_frame;
+            }
+        }
+        if (rc > 0 && !__keep(*pos)) {
+            av_frame_unref(__frame);
+            __dropped++;
+            rc = 0;
+        }
+    } while (rc == 0);
+    return rc == AVERROR_EOF ? 0 : rc;
+}
+
+void VideoDec::unget(double stamp, AVFrame *frame) {
+    __pending.push_back({ stamp, frame });
+}
+
+// 按时间格子选帧，不累计误差，输出时间戳保持原始时间戳
+bool VideoDec::__keep(double stamp) {
+    if (__rate <= 0) return true;
+
+    int64_t slot = (int64_t)floor(stamp * __rate + 1e-3);
+    if (slot < __next_slot) {
+        return false;
+    }
+    if (__skip_nonref && __next_slot != INT64_MIN && slot > __next_slot) {
+        // 参考帧不够密集，跳过非参考帧导致漏掉了输出帧
+        __skip_nonref = false;
+        __skip_frame = AVDISCARD_DEFAULT;
+        if (__skip_until < 0) {
+            __cc->skip_frame = __skip_frame;
+        }
+    }
+    __next_slot = slot + 1;
+    return true;
 }
 
 ////////////////// crop
+int FrameCrop::open(int w, int h, AVPixelFormat fmt, const std::vector<Box> &boxes, int cw, int ch,
+        Backend backend, AVRational time_base) {
+    __backend = backend;
+    __boxes = boxes;
+    __pos = boxes;
+    __w = w;
+    __h = h;
+    __tw = cw;
+    __th = ch;
+    if (backend == NATIVE) {
+        return __open_native(w, h, fmt, boxes, cw, ch);
+    }
+    return __open_filter(w, h, fmt, boxes, cw, ch, time_base);
+}
+
 // source -> split -> crop -> scale -> sink
 //               |
 //               ---> crop -> scale -> sink 
-int FrameCrop::open(int w, int h, AVPixelFormat fmt, const std::vector<Box> &boxes, int cw, int ch) {
+int FrameCrop::__open_filter(int w, int h, AVPixelFormat fmt, const std::vector<Box> &boxes, int cw, int ch,
+        AVRational time_base) {
     char buf[128];
     __graph = avfilter_graph_alloc();
 
     AVFilterContext *ctx_buffer;
-    snprintf(buf, sizeof(buf), "width=%d:height=%d:pix_fmt=yuv420p:time_base=1/25", w, h, "yuv420p");
+    snprintf(buf, sizeof(buf), "width=%d:height=%d:pix_fmt=yuv420p:time_base=%d/%d", w, h, time_base.num, time_base.den);
     int rc = avfilter_graph_create_filter(&ctx_buffer, avfilter_get_by_name("buffer"),
             "source", buf, 0, __graph);
     if (rc < 0) {
@@ -204,36 +465,277 @@ int FrameCrop::open(int w, int h, AVPixelFormat fmt, const std::vector<Box> &box
     return 0;
 }
 
+// box 必须在图像内部，并且左上角对齐到偶数保证色度平面对齐
+int FrameCrop::__open_native(int w, int h, AVPixelFormat fmt, const std::vector<Box> &boxes, int cw, int ch) {
+    if (fmt != AV_PIX_FMT_YUV420P && fmt != AV_PIX_FMT_YUVJ420P) {
+        fprintf(stderr, "ERR: %s:%d native crop only support yuv420p, fmt=%d\n", __func__, __LINE__, fmt);
+        return -1;
+    }
+
+    __resizers.resize(boxes.size() * 3);
+    for (int i = 0; i < boxes.size(); i++) {
+        if (__set_native_box(i, boxes[i]) < 0) {
+            return -1;
+        }
+    }
+
+    __inp = av_frame_alloc();
+    return __pool.init_video(cw, ch, AV_PIX_FMT_YUV420P);
+}
+
+int FrameCrop::__set_native_box(int i, const Box &b) {
+    Box box = b;
+    box.x1 = box.x1 < 0 ? 0 : box.x1 & ~1;
+    box.y1 = box.y1 < 0 ? 0 : box.y1 & ~1;
+    box.x2 = box.x2 > __w ? __w : box.x2;
+    box.y2 = box.y2 > __h ? __h : box.y2;
+
+    // 失败时保持原来的框
+    int bw = box.x2 - box.x1, bh = box.y2 - box.y1;
+    if (bw < 4 || bh < 4) {
+        fprintf(stderr, "ERR: %s:%d invalid box #%d: %d,%d,%d,%d\n", __func__, __LINE__, i,
+                box.x1, box.y1, box.x2, box.y2);
+        return -1;
+    }
+
+    // 大小不变只需要改变偏移
+    if (__resizers[i*3].same_size(bw, bh)) {
+        __boxes[i] = box;
+        return 0;
+    }
+
+    int cw = __tw, ch = __th;
+    if (__resizers[i*3].init(bw, bh, cw, ch) < 0 ||
+            __resizers[i*3+1].init((bw + 1) / 2, (bh + 1) / 2, (cw + 1) / 2, (ch + 1) / 2) < 0 ||
+            __resizers[i*3+2].init((bw + 1) / 2, (bh + 1) / 2, (cw + 1) / 2, (ch + 1) / 2) < 0) {
+        fprintf(stderr, "ERR: %s:%d invalid box #%d: %d,%d,%d,%d\n", __func__, __LINE__, i,
+                box.x1, box.y1, box.x2, box.y2);
+        return -1;
+    }
+    __boxes[i] = box;
+    return 0;
+}
+
+void FrameCrop::set_tracks(TrackSet *tracks) {
+    __tracks = tracks;
+}
+
+int FrameCrop::update(const std::vector<Box> &boxes) {
+    if (boxes.size() != __boxes.size()) {
+        fprintf(stderr, "ERR: %s:%d box count changed: %d vs %d\n", __func__, __LINE__,
+                (int)boxes.size(), (int)__boxes.size());
+        return -1;
+    }
+
+    if (__backend == NATIVE) {
+        int rc = 0;
+        for (int i = 0; i < boxes.size(); i++) {
+            if (__set_native_box(i, boxes[i]) < 0) {
+                rc = -1;
+            }
+        }
+        return rc;
+    }
+
+    char name[64], buf[32];
+    for (int i = 0; i < boxes.size(); i++) {
+        const Box &box = boxes[i], &init = __boxes[i];
+        int w = init.x2 - init.x1, h = init.y2 - init.y1;
+        int x = (box.x1 + box.x2 - w) / 2, y = (box.y1 + box.y2 - h) / 2;
+        x = x < 0 ? 0 : (x + w > __w ? __w - w : x);
+        y = y < 0 ? 0 : (y + h > __h ? __h - h : y);
+
+        Box &pos = __pos[i];
+        snprintf(name, sizeof(name), "crop_%d", i);
+        if (x != pos.x1) {
+            snprintf(buf, sizeof(buf), "%d", x);
+            avfilter_graph_send_command(__graph, name, "x", buf, 0, 0, 0);
+        }
+        if (y != pos.y1) {
+            snprintf(buf, sizeof(buf), "%d", y);
+            avfilter_graph_send_command(__graph, name, "y", buf, 0, 0, 0);
+        }
+        pos = { x, y, x + w, y + h, box.title, box.score };
+    }
+    return 0;
+}
+
 int FrameCrop::close() {
     avfilter_graph_free(&__graph);
     // for (auto filter: __filters) {
     //     avfilter_free(filter);
     // }
     __filters.clear();
+    __sinks.clear();
+
+    av_frame_free(&__inp);
+    __resizers.clear();
+
+    __out.clear();
+    __regions.clear();
+    __fanout.clear();
+    __levels.clear();
+    __pool.close();
     return 0;
 }
 
-int FrameCrop::put(AVFrame *frame) {
+int FrameCrop::put(AVFrame *frame, double stamp) {
+    if (__tracks && stamp >= 0) {
+        __tracks->at(stamp, __track_boxes);
+        update(__track_boxes);
+    }
+
+    if (__backend == NATIVE) {
+        // 只持有引用，不复制像素
+        av_frame_unref(__inp);
+        av_frame_move_ref(__inp, frame);
+        return 0;
+    }
     return av_buffersrc_add_frame(__src, frame);
 }
 
-std::vector<AVFrame *> FrameCrop::get() {
-    std::vector<AVFrame *> frames;
-    for (auto &sink: __sinks) {
-        AVFrame *frame = av_frame_alloc();
-        int rc = av_buffersink_get_frame(sink, frame);
-        if (rc >= 0)
-            frames.push_back(frame);
-        else {
-            av_frame_free(&frame);
-            frames.push_back(0);
+void FrameCrop::__get_native(std::vector<AVFrame*> &out) {
+    for (int i = 0; i < __boxes.size(); i++) {
+        AVFrame *frame = __inp->data[0] ? __pool.get_video() : nullptr;
+        if (!frame) {
+            out[i] = 0;
+            continue;
+        }
+        // 只需要时间戳，av_frame_copy_props 会复制 side data
+        frame->pts = __inp->pts;
+
+        const Box &box = __boxes[i];
+        for (int p = 0; p < 3; p++) {
+            int x = p ? box.x1 / 2 : box.x1, y = p ? box.y1 / 2 : box.y1;
+            const uint8_t *src = __inp->data[p] + (size_t)y * __inp->linesize[p] + x;
+            __resizers[i*3+p].resize(src, __inp->linesize[p], frame->data[p], frame->linesize[p]);
+        }
+        out[i] = frame;
+    }
+}
+
+int FrameCrop::add_level(int w, int h) {
+    if (w < 4 || h < 4 || w > __tw || h > __th || w % 2 || h % 2) {
+        fprintf(stderr, "ERR: %s:%d invalid level %dx%d, must be even and in 4x4 ~ %dx%d\n", __func__, __LINE__,
+                w, h, __tw, __th);
+        return -1;
+    }
+
+    // 从能覆盖它的最小一级缩放，误差和计算量都最小
+    Level level;
+    level.w = w;
+    level.h = h;
+    level.parent = 0;
+    int pw = __tw, ph = __th;
+    for (int k = 0; k < __levels.size(); k++) {
+        const Level &l = __levels[k];
+        if (l.w >= w && l.h >= h && l.w * l.h < pw * ph) {
+            level.parent = k + 1;
+            pw = l.w;
+            ph = l.h;
+        }
+    }
+    if (level.resizers[0].init(pw, ph, w, h) < 0 ||
+            level.resizers[1].init((pw + 1) / 2, (ph + 1) / 2, (w + 1) / 2, (h + 1) / 2) < 0 ||
+            level.resizers[2].init((pw + 1) / 2, (ph + 1) / 2, (w + 1) / 2, (h + 1) / 2) < 0) {
+        return -1;
+    }
+    level.pool = __pool.add_video(w, h, AV_PIX_FMT_YUV420P);
+    if (level.pool < 0) {
+        return -1;
+    }
+    __levels.push_back(level);
+    return 0;
+}
+
+// 按 add_level 的顺序计算，父级总是在前面
+void FrameCrop::__get_levels(std::vector<AVFrame*> &out) {
+    int n = __boxes.size();
+    for (int k = 0; k < __levels.size(); k++) {
+        Level &level = __levels[k];
+        for (int i = 0; i < n; i++) {
+            AVFrame *src = out[level.parent * n + i];
+            AVFrame *frame = src ? __pool.get_video(level.pool) : nullptr;
+            if (frame) {
+                frame->pts = src->pts;
+                for (int p = 0; p < 3; p++) {
+                    level.resizers[p].resize(src->data[p], src->linesize[p], frame->data[p], frame->linesize[p]);
+                }
+            }
+            out[(k + 1) * n + i] = frame;
+        }
+    }
+}
+
+const std::vector<AVFrame *> &FrameCrop::get() {
+    std::vector<AVFrame *> &res = __fanout.empty() ? __out : __regions;
+    res.resize(__boxes.size() * levels());
+    if (__backend == NATIVE) {
+        __get_native(res);
+    }
+    else {
+        for (int i = 0; i < __sinks.size(); i++) {
+            AVFrame *frame = __pool.get();
+            int rc = av_buffersink_get_frame(__sinks[i], frame);
+            if (rc >= 0)
+                res[i] = frame;
+            else {
+                __pool.put(frame);
+                res[i] = 0;
+            }
+        }
+    }
+    if (!__levels.empty()) {
+        __get_levels(res);
+    }
+    if (__fanout.empty()) {
+        return __out;
+    }
+
+    // 每个输出框一个引用，不复制像素，各自 release
+    int n = __boxes.size(), m = __fanout.size();
+    __out.resize(m * levels());
+    for (int k = 0; k < levels(); k++) {
+        for (int i = 0; i < m; i++) {
+            AVFrame *src = __regions[k * n + __fanout[i]], *frame = nullptr;
+            if (src) {
+                frame = __pool.get();
+                if (av_frame_ref(frame, src) < 0) {
+                    __pool.put(frame);
+                    frame = nullptr;
+                }
+            }
+            __out[k * m + i] = frame;
+        }
+    }
+    for (auto frame: __regions) {
+        __pool.put(frame);
+    }
+    return __out;
+}
+
+int FrameCrop::set_fanout(const std::vector<int> &region_of) {
+    for (int r: region_of) {
+        if (r < 0 || r >= __boxes.size()) {
+            fprintf(stderr, "ERR: %s:%d invalid region: %d, %d regions\n", __func__, __LINE__, r, (int)__boxes.size());
+            return -1;
         }
     }
-    return frames;
+    // 一一对应时不需要额外的引用
+    bool identity = region_of.size() == __boxes.size();
+    for (int i = 0; identity && i < region_of.size(); i++) {
+        identity = region_of[i] == i;
+    }
+    __fanout = identity ? std::vector<int>() : region_of;
+    return 0;
+}
+
+void FrameCrop::release(AVFrame *frame) {
+    __pool.put(frame);
 }
 
 ////////////////// enc
-int VideoEnc::open(const char *fname, int width, int height, int fps, int bitrate) {
+int VideoEnc::open(const char *fname, int width, int height, double fps, int bitrate, bool fragmented) {
     const AVOutputFormat *fmt = av_guess_format(NULL, fname, NULL);
     int rc = avformat_alloc_output_context2(&__fc, fmt, NULL, fname);
     if (rc < 0) {
@@ -241,60 +743,119 @@ int VideoEnc::open(const char *fname, int width, int height, int fps, int bitrat
         return -1;
     }
 
-    const AVCodec *c = avcodec_find_encoder(AV_CODEC_ID_H264);
-    if (!c) {
-        fprintf(stderr, "ERR: %s:%d not encoder for h264!\n", __func__, __LINE__);
+    if (__open_codec(width, height, fps, bitrate) < 0) {
         return -1;
     }
 
-    AVStream *stream = avformat_new_stream(__fc, c);
+    AVStream *stream = avformat_new_stream(__fc, 0);
     if (!stream) {
         fprintf(stderr, "ERR: %s:%d cannot create new stream!\n", __func__, __LINE__);
         return -1;
     }
-
-    __cc = avcodec_alloc_context3(c);
-    stream->codecpar->codec_type = AVMEDIA_TYPE_VIDEO;
-    stream->codecpar->codec_id = c->id;
-    stream->codecpar->width = width;
-    stream->codecpar->height = height;
-    stream->codecpar->format = AV_PIX_FMT_YUV420P;
-    stream->codecpar->bit_rate = bitrate;
-    avcodec_parameters_to_context(__cc, stream->codecpar);
-    __cc->time_base = (AVRational){ 1, 90000 };
-    __cc->max_b_frames = 0;
-    __cc->gop_size = fps;
-    __cc->framerate = (AVRational){ fps, 1};
-    av_opt_set(__cc, "preset", "ultrafast", 0);
     avcodec_parameters_from_context(stream->codecpar, __cc);
+    stream->time_base = __cc->time_base;
+
+    // hls 等自己打开文件
+    if (!(__fc->oformat->flags & AVFMT_NOFILE)) {
+        rc = avio_open(&__fc->pb, fname, AVIO_FLAG_WRITE);
+        if (rc < 0) {
+            fprintf(stderr, "ERR: %s:%d failed to open write file!\n", __func__, __LINE__);
+            return -1;
+        }
+    }
 
-    rc = avcodec_open2(__cc, c, 0);
+    AVDictionary *opts = nullptr;
+    if (fragmented) {
+        av_dict_set(&opts, "movflags", "frag_keyframe+empty_moov+default_base_moof", 0);
+        av_dict_set(&opts, "flush_packets", "1", 0);
+    }
+    if (__cfg.segment > 0 && strcmp(__fc->oformat->name, "hls") == 0) {
+        // 各个框的文件在同一目录，分段和初始化段使用各自的名字；分段写完后才改名，读端看不到不完整的分段
+        std::string base(fname, strrchr(fname, '.') - fname);
+        const char *slash = strrchr(base.c_str(), '/');
+        std::string init = (slash ? slash + 1 : base.c_str()) + std::string("-init.mp4");
+        av_dict_set(&opts, "hls_time", std::to_string(__cfg.segment).c_str(), 0);
+        av_dict_set(&opts, "hls_list_size", "0", 0);
+        av_dict_set(&opts, "hls_playlist_type", "event", 0);
+        av_dict_set(&opts, "hls_segment_type", "fmp4", 0);
+        av_dict_set(&opts, "hls_segment_filename", (base + "-%05d.m4s").c_str(), 0);
+        av_dict_set(&opts, "hls_fmp4_init_filename", init.c_str(), 0);
+        av_dict_set(&opts, "hls_flags", "independent_segments+temp_file", 0);
+    }
+    rc = avformat_write_header(__fc, &opts);
+    av_dict_free(&opts);
     if (rc < 0) {
-        fprintf(stderr, "ERR: %s:%d failed to open enc!!\n", __func__, __LINE__);
-        return -1;
+        fprintf(stderr, "ERR: %s:%d failed to write head!!\n", __func__, __LINE__);
+        return 0;
     }
 
-    rc = avio_open(&__fc->pb, fname, AVIO_FLAG_WRITE);
-    if (rc < 0) {
-        fprintf(stderr, "ERR: %s:%d failed to open write file!\n", __func__, __LINE__);
+    return 0;
+}
+
+int VideoEnc::open(PacketSink sink, int width, int height, double fps, int bitrate) {
+    __sink = sink;
+    return __open_codec(width, height, fps, bitrate);
+}
+
+int VideoEnc::__open_codec(int width, int height, double fps, int bitrate) {
+    const AVCodec *c = avcodec_find_encoder(AV_CODEC_ID_H264);
+    if (!c) {
+        fprintf(stderr, "ERR: %s:%d not encoder for h264!\n", __func__, __LINE__);
         return -1;
     }
 
-    rc = avformat_write_header(__fc, 0);
+    __cc = avcodec_alloc_context3(c);
+    __cc->codec_type = AVMEDIA_TYPE_VIDEO;
+    __cc->codec_id = c->id;
+    __cc->width = width;
+    __cc->height = height;
+    __cc->pix_fmt = AV_PIX_FMT_YUV420P;
+    __cc->bit_rate = bitrate;
+    __cc->time_base = (AVRational){ 1, 90000 };
+    __cc->max_b_frames = 0;
+    __cc->gop_size = fps >= 1 ? (int)(fps + 0.5) : 1;
+    if (__cfg.segment > 0) {
+        // 关键帧只在分段边界强制产生，GOP 与分段对齐
+        __cc->gop_size = (int)(2 * __cfg.segment * fps + 0.5) + 1;
+        av_opt_set(__cc, "forced-idr", "1", AV_OPT_SEARCH_CHILDREN);
+    }
+    __cc->framerate = av_d2q(fps, 1001);
+    __cc->thread_count = __cfg.threads;
+    if (__cfg.global_header) {
+        __cc->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+    }
+    av_opt_set(__cc, "preset", "ultrafast", 0);
+    if (__cfg.low_latency) {
+        // preset/tune 是 libx264 的私有选项，需要搜索 priv_data；上面的设置不会到达 x264，默认仍为 medium
+        av_opt_set(__cc, "preset", "ultrafast", AV_OPT_SEARCH_CHILDREN);
+        av_opt_set(__cc, "tune", "zerolatency", AV_OPT_SEARCH_CHILDREN);
+    }
+
+    int rc = avcodec_open2(__cc, c, 0);
     if (rc < 0) {
-        fprintf(stderr, "ERR: %s:%d failed to write head!!\n", __func__, __LINE__);
-        return 0;
+        fprintf(stderr, "ERR: %s:%d failed to open enc!!\n", __func__, __LINE__);
+        return -1;
     }
 
+    __pkt = av_packet_alloc();
     return 0;
 }
 
 int VideoEnc::close() {
-    put_frame(0, 0);
-    av_write_trailer(__fc);
-    avio_close(__fc->pb);
-    avformat_free_context(__fc);
-    avcodec_close(__cc);
+    if (__cc) {
+        put_frame(0, 0);
+    }
+    if (__fc) {
+        av_write_trailer(__fc);
+        avio_close(__fc->pb);
+        avformat_free_context(__fc);
+        __fc = nullptr;
+    }
+    if (__cc) {
+        avcodec_close(__cc);
+        avcodec_free_context(&__cc);
+    }
+    av_packet_free(&__pkt);
     return 0;
 }
 
@@ -308,24 +869,39 @@ int VideoEnc::put_frame(double stamp, AVFrame *frame) {
     if (frame) {
         frame->pts = (int64_t)(stamp * __cc->time_base.den / __cc->time_base.num);
         frame->time_base = __cc->time_base;
+        if (__cfg.segment > 0) {
+            int64_t idx = (int64_t)floor(stamp / __cfg.segment + 1e-6);
+            // 其它帧的类型来自解码器（filter 会复制），不清除时源中的 I 帧都会变成额外的 IDR
+            if (idx != __seg_idx) {
+                frame->pict_type = AV_PICTURE_TYPE_I;
+                __seg_idx = idx;
+            }
+            else {
+                frame->pict_type = AV_PICTURE_TYPE_NONE;
+            }
+        }
     }
 
     int rc = avcodec_send_frame(__cc, frame);
     if (rc < 0) {
         fprintf(stderr, "ERR: %s:%d enc send frame err!\n", __func__, __LINE__);
-        return 0;
+        return frame ? -1 : 0;
     }
 
-    AVPacket *pkt = av_packet_alloc();
-    pkt->data = nullptr;
-    pkt->size = 0;
-    pkt->flags |= AV_PKT_FLAG_KEY;
-    rc = avcodec_receive_packet(__cc, pkt);
-    if (rc == 0) {
-        av_interleaved_write_frame(__fc, pkt);
-        av_packet_unref(pkt);
+    // 编码器可能一次输出多个 packet，flush 时需要全部取出
+    int ret = 0;
+    while ((rc = avcodec_receive_packet(__cc, __pkt)) == 0) {
+        __bytes += __pkt->size;
+        if (__sink) {
+            if (__sink(__pkt) < 0) ret = -1;
+        }
+        else {
+            av_packet_rescale_ts(__pkt, __cc->time_base, __fc->streams[0]->time_base);
+            __pkt->stream_index = 0;
+            av_interleaved_write_frame(__fc, __pkt);
+        }
+        av_packet_unref(__pkt);
     }
-    av_packet_free(&pkt);
 
-    return 0;
-}
\ No newline at end of file
+    return ret;
+}
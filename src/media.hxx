@@ -11,6 +11,25 @@ extern "C" {
 
 #include <vector>
 #include <string>
+#include <functional>
+#include <deque>
+
+#include "resize.hxx"
+#include "index.hxx"
+#include "track.hxx"
+#include "pool.hxx"
+
+/// 解码器配置
+struct DecConfig {
+    int threads = 0;        // 解码线程数，0 由 libavcodec 根据 cpu 数决定
+    int thread_type = FF_THREAD_FRAME | FF_THREAD_SLICE;
+    bool fast = false;      // 非参考帧跳过环路滤波，并允许不严格的加速
+    bool index = false;     // 使用关键帧索引 <fname>.kidx，不存在时生成
+    double follow = 0.0;    // > 0: 文件还在写入（或为 FIFO），读到结尾时等待新数据，
+                            // 超过 follow 秒没有增长认为写入结束；不支持 seek 和索引
+    AVIOContext *io = nullptr;  // 调用者提供的输入（回调/内存），由调用者释放；fname 只用于日志
+                                // 不使用索引，不可 seek 时从头解码并丢弃起始时间之前的帧
+};
 
 /// 视频解码
 class VideoDec {
@@ -23,20 +42,59 @@ class VideoDec {
 
     AVPacket *__pkt = nullptr;
     AVFrame *__frame = nullptr;
+    bool __draining = false;    // 已读到文件尾，正在取出解码器缓存的帧
+
+    KeyIndex __index;
+    bool __indexed = false;
+
+    // follow 模式自己读文件
+    struct Follow {
+        int fd = -1;
+        bool fifo = false;
+        double timeout = 0.0;
+    } __follow;
+    AVIOContext *__avio = nullptr;
+    double __skip_until = -1.0;     // seek 之后丢弃该时间戳之前的帧
+    AVDiscard __skip_frame = AVDISCARD_DEFAULT;
+
+    double __rate = 0.0;            // 输出帧率，0 不丢帧
+    int64_t __next_slot = INT64_MIN;
+    bool __skip_nonref = false;     // 丢帧较多时让解码器跳过非参考帧
+    int64_t __dropped = 0;
+
+    std::deque<std::pair<double, AVFrame *>> __pending;    // unget() 放回的帧
 
 public:
     // 打开输入视频文件
-    int open(const char *fname);
+    int open(const char *fname, const DecConfig &cfg = DecConfig());
     int close();
 
     double get_duration();
     int seek(double pos);
+    // 可以 seek: 普通文件，或可 seek 的自定义输入；follow 模式不可以
+    bool seekable() const;
+    // 不 seek，继续向后解码并丢弃 pos 之前的帧（跳过非参考帧），距离较近时比 seek 后重新解码 GOP 更快
+    void skip_to(double pos);
+
+    // 按输出帧率丢帧: 每 1/fps 秒只返回第一帧，0 不丢帧
+    // 输入帧率不低于 2 倍 fps 时解码器跳过非参考帧，发现因此漏掉输出帧后恢复
+    void set_rate(double fps);
+    int64_t dropped() const { return __dropped; }
+
+    double frame_rate() const;
+    AVRational time_base() const;
     
     // 返回: > 0 得到 frame, == 0 EOF, < 0 失败
     int get_frame(double *stamp, AVFrame **frame);
+    // 放回已取出的帧（av_frame_clone 得到，所有权转移），之后 get_frame 按放回的顺序先返回
+    void unget(double stamp, AVFrame *frame);
 
 private:
+    int __open_follow(const char *fname, double timeout);
+    static int __follow_read(void *opaque, uint8_t *buf, int size);
     int __try_get_frame(double *stamp, AVFrame **frame);
+    double __frame_stamp();
+    bool __keep(double stamp);
 };
 
 
@@ -49,6 +107,14 @@ public:
 
 /// 图像多路 crop resize 到 (w, h)
 class FrameCrop {
+public:
+    enum Backend {
+        FILTER,     // avfilter: buffer -> split -> crop -> scale -> buffersink
+        NATIVE,     // 按平面指针偏移 crop，缩放（见 PlaneResizer）直接写入输出帧
+    };
+
+private:
+    Backend __backend = FILTER;
     std::vector<Box> __boxes;
     AVFilterGraph *__graph = nullptr;
 
@@ -56,27 +122,131 @@ class FrameCrop {
     
     AVFilterContext *__src;
     std::vector<AVFilterContext*> __sinks;
+
+    int __w = 0, __h = 0;
+    std::vector<Box> __pos;         // FILTER: 当前 crop 位置，大小固定为 open 时的大小
+
+    // NATIVE
+    int __tw = 0, __th = 0;
+    AVFrame *__inp = nullptr;
+    std::vector<PlaneResizer> __resizers;   // 每个 box 3 个平面
+
+    TrackSet *__tracks = nullptr;
+    std::vector<Box> __track_boxes;
+
+    FramePool __pool;               // 输出帧
+    std::vector<AVFrame*> __out;    // get() 的结果，每帧复用
+
+    std::vector<int> __fanout;      // 输出框 -> crop 区域，为空时一一对应
+    std::vector<AVFrame*> __regions;    // 有 fanout 时每个区域的 crop 结果
+
+    // 额外的输出大小，由不小于它的最小一级缩放得到，不再从原图 crop
+    struct Level {
+        int w, h;
+        int parent;                 // 0 为 open 时的大小，k 为 __levels[k-1]
+        int pool;                   // __pool.get_video() 的序号
+        PlaneResizer resizers[3];
+    };
+    std::vector<Level> __levels;
+
 public:
+    // time_base: 输入帧 pts 的时间基
     int open(int w, int h, AVPixelFormat fmt, const std::vector<Box> &boxes, 
-            int target_width, int target_height);    // 
+            int target_width, int target_height, Backend backend = FILTER,
+            AVRational time_base = { 1, 25 });
     int close();
 
-    int put(AVFrame *frame);
-    std::vector<AVFrame*> get();
+    // 每帧根据 stamp 从轨迹更新框，轨迹数必须和 open 时的框数相同
+    void set_tracks(TrackSet *tracks);
+
+    // 更新框位置，不重建 filter graph
+    // NATIVE 支持任意大小变化，FILTER 只移动位置（保持 open 时大小，对齐新框中心）
+    int update(const std::vector<Box> &boxes);
+
+    // 多个输出框共用 crop 区域，region_of[i] 为输出框 i 使用的区域（open 时的框下标）
+    // 之后 size()/get() 按输出框计算，共用区域的帧引用同一图像；update()/轨迹仍按区域
+    int set_fanout(const std::vector<int> &region_of);
+
+    // 增加一级输出大小，宽高都不能超过 open 时的大小，必须在第一帧之前调用
+    // 之后 size()/get() 按级排列: 第 k 级（0 为 open 时的大小）的输出框 i 下标为 k * 框数 + i
+    int add_level(int w, int h);
+    int levels() const { return 1 + __levels.size(); }
+
+    int size() const { return (__fanout.empty() ? __boxes.size() : __fanout.size()) * levels(); }
+
+    int put(AVFrame *frame, double stamp = -1.0);
+
+    // 每个框一帧，失败为 nullptr，使用完后必须 release()
+    // 返回的 vector 在下次 get() 时被覆盖
+    const std::vector<AVFrame*> &get();
+    void release(AVFrame *frame);
+
+    // 输出帧池的统计: 创建的帧数，同时使用的最大帧数
+    int pool_total() const { return __pool.total(); }
+    int pool_high_water() const { return __pool.high_water(); }
+
+private:
+    int __open_filter(int w, int h, AVPixelFormat fmt, const std::vector<Box> &boxes, int cw, int ch,
+            AVRational time_base);
+    int __open_native(int w, int h, AVPixelFormat fmt, const std::vector<Box> &boxes, int cw, int ch);
+    int __set_native_box(int i, const Box &box);
+    void __get_native(std::vector<AVFrame*> &out);
+    void __get_levels(std::vector<AVFrame*> &out);
+};
+
+/// 编码器资源配置
+struct EncConfig {
+    int threads = 0;            // 编码线程数，0 由 libx264 决定（约 1.5 倍 cpu 数，每个线程都有帧缓存）
+    bool low_latency = false;   // preset=ultrafast tune=zerolatency: 没有 lookahead 和 B 帧，编码器内缓存的帧最少
+    double segment = 0.0;       // > 0: 每 segment 秒（从 origin 开始）强制一个 IDR，输出 .m3u8 时按此分段
+    bool global_header = false; // SPS/PPS 只在 extradata 中，不在关键帧中重复，用于 sink 模式写入外部容器
 };
 
 /// 视频编码
 class VideoEnc {
+public:
+    // packet 的时间基为 1/90000，pts 从 set_origin()/第一帧开始；返回后 packet 被释放，返回 < 0 时 put_frame 失败
+    typedef std::function<int(AVPacket *pkt)> PacketSink;
+
+private:
     AVFormatContext *__fc = nullptr;
     AVCodecContext *__cc = nullptr;
+    AVPacket *__pkt = nullptr;      // 复用，避免每帧分配
+    PacketSink __sink;              // 不为空时不写文件
 
     double __stamp_off = -1.0;
+    int64_t __bytes = 0;            // 已写入的 packet 字节数
+    EncConfig __cfg;
+    int64_t __seg_idx = -1;         // 当前分段序号
 
 public:
-    int open(const char *fname, int width, int height, int fps=25, int bitrate=50000);
+    // 必须在 open 之前调用
+    void configure(const EncConfig &cfg) { __cfg = cfg; }
+
+    // fps 决定 GOP 长度（1 秒）和容器中的帧率，时间戳仍取自 put_frame 的 stamp
+    // fragmented: 输出 fragmented mp4，每个关键帧写出一个 fragment，写入过程中即可读取
+    // fname 为 .m3u8 时使用 hls 分段 (fmp4): 需要 configure 的 segment > 0，分段为 <name>-NNNNN.m4s，
+    // 初始化段为 <name>-init.mp4，播放列表为 event 类型，每个分段完成后追加
+    int open(const char *fname, int width, int height, double fps=25, int bitrate=50000,
+            bool fragmented=false);
+    // 不写文件，编码后的 packet 交给 sink（Annex B，SPS/PPS 在关键帧中）
+    int open(PacketSink sink, int width, int height, double fps=25, int bitrate=50000);
     int close();
 
+    // 返回 < 0 编码失败
     int put_frame(double stamp, AVFrame *frame);
+
+    int64_t bytes() const { return __bytes; }
+
+    // 编码参数（含 extradata），open 之后有效，用于在外部容器中建流
+    int params(AVCodecParameters *par) const { return avcodec_parameters_from_context(par, __cc); }
+
+    // 时间戳 stamp 对应 pts 0，默认为第一帧的时间戳，必须在第一帧之前调用
+    void set_origin(double stamp) { __stamp_off = stamp; }
+    double origin() const { return __stamp_off; }
+
+private:
+    int __open_codec(int width, int height, double fps, int bitrate);
 };
 
 #endif // 
\ No newline at end of file
@@ -0,0 +1,135 @@
+#include "mosaic.hxx"
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <string>
+#include <algorithm>
+
+int MosaicOutput::open(const std::vector<Box> &boxes, const char *fname, int tw, int th, double fps, int cols,
+        bool fragmented) {
+    __cnt = boxes.size();
+    if (__cnt <= 0) {
+        return -1;
+    }
+    __cols = cols > 0 ? cols : (int)ceil(sqrt((double)__cnt));
+    if (__cols > __cnt) __cols = __cnt;
+    int rows = (__cnt + __cols - 1) / __cols;
+    // 格子大小取偶数，色度平面的格子边界才能对齐，多出的一行/列为黑色
+    __written.assign(__cnt, false);
+    __tw = (tw + 1) & ~1;
+    __th = (th + 1) & ~1;
+
+    __canvas = av_frame_alloc();
+    __canvas->width = __cols * __tw;
+    __canvas->height = rows * __th;
+    __canvas->format = AV_PIX_FMT_YUV420P;
+    if (av_frame_get_buffer(__canvas, 0) < 0) {
+        fprintf(stderr, "ERR: %s:%d cannot alloc canvas %dx%d\n", __func__, __LINE__,
+                __canvas->width, __canvas->height);
+        av_frame_free(&__canvas);
+        return -1;
+    }
+    // 没有内容的格子为黑色
+    __fill_black(0, 0, __canvas->width, __canvas->height);
+
+    // 码率按格子数增加
+    if (__enc.open(fname, __canvas->width, __canvas->height, fps, 50000 * __cnt, fragmented) < 0) {
+        fprintf(stderr, "ERR: %s:%d cannot open mosaic output: %s\n", __func__, __LINE__, fname);
+        av_frame_free(&__canvas);
+        return -1;
+    }
+    __opened = true;
+    __fname = fname;
+
+    return __write_tiles(fname, boxes);
+}
+
+int MosaicOutput::__write_tiles(const char *fname, const std::vector<Box> &boxes) {
+    std::string path = std::string(fname) + ".tiles";
+    FILE *fp = fopen(path.c_str(), "w");
+    if (!fp) {
+        fprintf(stderr, "ERR: %s:%d cannot write tile index: %s\n", __func__, __LINE__, path.c_str());
+        return -1;
+    }
+    fprintf(fp, "# %s %dx%d tiles %d cols %d\n", fname, __canvas->width, __canvas->height, __cnt, __cols);
+    fprintf(fp, "# box_id tile_x tile_y tile_w tile_h cls score x1 y1 x2 y2\n");
+    for (int i = 0; i < boxes.size(); i++) {
+        const Box &b = boxes[i];
+        fprintf(fp, "%d %d %d %d %d %s %.03f %d %d %d %d\n", i, (i % __cols) * __tw, (i / __cols) * __th,
+                __tw, __th, b.title, b.score, b.x1, b.y1, b.x2, b.y2);
+    }
+    fclose(fp);
+    return 0;
+}
+
+void MosaicOutput::__fill_black(int x, int y, int w, int h) {
+    for (int r = 0; r < h; r++) {
+        memset(__canvas->data[0] + (y + r) * __canvas->linesize[0] + x, 16, w);
+    }
+    for (int r = 0; r < h / 2; r++) {
+        memset(__canvas->data[1] + (y / 2 + r) * __canvas->linesize[1] + x / 2, 128, w / 2);
+        memset(__canvas->data[2] + (y / 2 + r) * __canvas->linesize[2] + x / 2, 128, w / 2);
+    }
+}
+
+int MosaicOutput::__flush() {
+    if (!__pending) {
+        return 0;
+    }
+    __pending = false;
+    // 这一时刻没有 crop 结果的框（crop 失败时不会调用 put_frame），不能留着上一帧的内容
+    for (int i = 0; i < __cnt; i++) {
+        if (!__written[i]) {
+            __fill_black((i % __cols) * __tw, (i / __cols) * __th, __tw, __th);
+        }
+        __written[i] = false;
+    }
+    return __enc.put_frame(__stamp, __canvas);
+}
+
+int MosaicOutput::put_frame(int box, double stamp, AVFrame *frame) {
+    if (__pending && stamp != __stamp) {
+        // 上一时刻部分框缺失，直接编码
+        __flush();
+    }
+    __stamp = stamp;
+
+    // 编码器可能还持有画布的引用
+    if (av_frame_make_writable(__canvas) < 0) {
+        fprintf(stderr, "ERR: %s:%d cannot make canvas writable\n", __func__, __LINE__);
+        return -1;
+    }
+
+    int x = (box % __cols) * __tw, y = (box / __cols) * __th;
+    if (frame) {
+        // 奇数大小的帧只覆盖格子的一部分，其余保持打开时的黑色
+        int fw = std::min(frame->width, __tw), fh = std::min(frame->height, __th);
+        for (int p = 0; p < 3; p++) {
+            int sx = p ? x / 2 : x, sy = p ? y / 2 : y;
+            int w = p ? (fw + 1) / 2 : fw, h = p ? (fh + 1) / 2 : fh;
+            uint8_t *dst = __canvas->data[p] + sy * __canvas->linesize[p] + sx;
+            const uint8_t *src = frame->data[p];
+            for (int r = 0; r < h; r++) {
+                memcpy(dst + r * __canvas->linesize[p], src + r * frame->linesize[p], w);
+            }
+        }
+        __written[box] = true;
+        __pending = true;
+    }
+
+    if (box == __cnt - 1) {
+        return __flush();
+    }
+    return 0;
+}
+
+int MosaicOutput::close() {
+    if (__opened) {
+        __flush();
+        __enc.close();
+        __opened = false;
+    }
+    av_frame_free(&__canvas);
+    return 0;
+}
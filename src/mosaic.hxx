@@ -0,0 +1,48 @@
+#ifndef _mosaic_hh
+#define _mosaic_hh
+
+#include "output.hxx"
+
+/// 所有框拼成一张大图，只用一个编码器
+/// 同一时刻的各个框按顺序到达，最后一个框到达（或时间戳变化）时编码
+/// 同时生成 <fname>.tiles，每行: box_id tile_x tile_y tile_w tile_h cls score x1 y1 x2 y2
+class MosaicOutput : public CropOutput {
+    VideoEnc __enc;
+    std::string __fname;
+    AVFrame *__canvas = nullptr;
+    bool __opened = false;
+
+    int __cnt = 0;
+    int __cols = 0;
+    int __tw = 0, __th = 0;
+
+    double __stamp = -1.0;
+    bool __pending = false;     // 画布中有尚未编码的内容
+    std::vector<bool> __written;    // 当前时刻已写入的格子，编码时其余格子填黑色
+
+public:
+    // fps: 输出帧率，cols: 每行的格子数，0 自动接近正方形，fragmented: 见 VideoEnc::open
+    int open(const std::vector<Box> &boxes, const char *fname, int tile_width, int tile_height,
+            double fps = 25, int cols = 0, bool fragmented = false);
+
+    // 拼图需要同一线程收到所有框
+    int lanes() const override { return 1; }
+    int lane(int box) const override { return 0; }
+
+    int put_frame(int box, double stamp, AVFrame *frame) override;
+    int64_t bytes(int box) const override { return box < 0 ? __enc.bytes() : 0; }
+    void set_origin(double stamp) override { __enc.set_origin(stamp); }
+    std::vector<std::string> files() const override { return { __fname }; }
+    int close() override;
+
+    // 当前画布，测试使用
+    const AVFrame *canvas() const { return __canvas; }
+
+private:
+    int __write_tiles(const char *fname, const std::vector<Box> &boxes);
+    int __flush();
+    // 画布上的区域填充黑色，x/y/w/h 为偶数
+    void __fill_black(int x, int y, int w, int h);
+};
+
+#endif // mosaic.hxx
@@ -0,0 +1,191 @@
+#include "motion.hxx"
+
+#include <stdlib.h>
+#include <algorithm>
+
+// _mm_cvtsi128_si64 只有 64 位可用
+#if defined(__x86_64__)
+#   include <immintrin.h>
+#   define SAD_X86 1
+#endif
+
+typedef uint64_t (*sad_func)(const uint8_t *a, const uint8_t *b, int n);
+typedef void (*accum_func)(uint16_t *acc, const uint8_t *src, int n);
+
+////////////////// c
+static uint64_t sad_c(const uint8_t *a, const uint8_t *b, int n) {
+    uint64_t sum = 0;
+    for (int i = 0; i < n; i++) {
+        sum += abs(a[i] - b[i]);
+    }
+    return sum;
+}
+
+// acc[i] += src[i]
+static void accum_c(uint16_t *acc, const uint8_t *src, int n) {
+    for (int i = 0; i < n; i++) {
+        acc[i] += src[i];
+    }
+}
+
+#ifdef SAD_X86
+////////////////// sse2
+__attribute__((target("sse2")))
+static uint64_t sad_sse2(const uint8_t *a, const uint8_t *b, int n) {
+    __m128i acc = _mm_setzero_si128();
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i va = _mm_loadu_si128((const __m128i *)(a + i));
+        __m128i vb = _mm_loadu_si128((const __m128i *)(b + i));
+        acc = _mm_add_epi64(acc, _mm_sad_epu8(va, vb));
+    }
+    uint64_t sum = (uint64_t)_mm_cvtsi128_si64(acc) + (uint64_t)_mm_cvtsi128_si64(_mm_unpackhi_epi64(acc, acc));
+    return sum + sad_c(a + i, b + i, n - i);
+}
+
+__attribute__((target("sse2")))
+static void accum_sse2(uint16_t *acc, const uint8_t *src, int n) {
+    const __m128i zero = _mm_setzero_si128();
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(src + i));
+        __m128i lo = _mm_loadu_si128((const __m128i *)(acc + i));
+        __m128i hi = _mm_loadu_si128((const __m128i *)(acc + i + 8));
+        _mm_storeu_si128((__m128i *)(acc + i), _mm_add_epi16(lo, _mm_unpacklo_epi8(v, zero)));
+        _mm_storeu_si128((__m128i *)(acc + i + 8), _mm_add_epi16(hi, _mm_unpackhi_epi8(v, zero)));
+    }
+    accum_c(acc + i, src + i, n - i);
+}
+
+////////////////// avx2
+__attribute__((target("avx2")))
+static uint64_t sad_avx2(const uint8_t *a, const uint8_t *b, int n) {
+    __m256i acc = _mm256_setzero_si256();
+    int i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i va = _mm256_loadu_si256((const __m256i *)(a + i));
+        __m256i vb = _mm256_loadu_si256((const __m256i *)(b + i));
+        acc = _mm256_add_epi64(acc, _mm256_sad_epu8(va, vb));
+    }
+    __m128i s = _mm_add_epi64(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+    uint64_t sum = (uint64_t)_mm_cvtsi128_si64(s) + (uint64_t)_mm_cvtsi128_si64(_mm_unpackhi_epi64(s, s));
+    return sum + sad_c(a + i, b + i, n - i);
+}
+
+__attribute__((target("avx2")))
+static void accum_avx2(uint16_t *acc, const uint8_t *src, int n) {
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m256i v = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(src + i)));
+        __m256i a = _mm256_loadu_si256((const __m256i *)(acc + i));
+        _mm256_storeu_si256((__m256i *)(acc + i), _mm256_add_epi16(a, v));
+    }
+    accum_c(acc + i, src + i, n - i);
+}
+#endif // x86
+
+////////////////// dispatch
+struct SadImpl {
+    const char *name;
+    sad_func sad;
+    accum_func accum;
+
+    SadImpl() : name("c"), sad(sad_c), accum(accum_c) {
+#ifdef SAD_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) {
+            name = "avx2";
+            sad = sad_avx2;
+            accum = accum_avx2;
+        }
+        else if (__builtin_cpu_supports("sse2")) {
+            name = "sse2";
+            sad = sad_sse2;
+            accum = accum_sse2;
+        }
+#endif // x86
+    }
+};
+
+static const SadImpl _impl;
+
+uint64_t sad_u8(const uint8_t *a, const uint8_t *b, int n) {
+    return _impl.sad(a, b, n);
+}
+
+const char *sad_impl_name() {
+    return _impl.name;
+}
+
+////////////////// gate
+GateOutput::GateOutput(CropOutput *out, int boxes, const GateConfig &cfg)
+    : __out(out), __cfg(cfg), __states(boxes) {
+    // 行累加为 16bit，块不能超过 16x16
+    __cfg.scale = std::min(std::max(__cfg.scale, 1), 16);
+}
+
+GateOutput::~GateOutput() {
+    for (auto &s: __states) {
+        av_frame_free(&s.tail);
+    }
+    delete __out;
+}
+
+// 亮度按块平均，降低噪声的影响，也减少比较的数据量
+// 先把 k 行按列累加（SIMD），再每 k 列求和
+void GateOutput::__thumb(const AVFrame *frame, std::vector<uint8_t> &thumb) {
+    int k = __cfg.scale, tw = frame->width / k, th = frame->height / k, w = tw * k;
+    thumb.resize(tw * th);
+    std::vector<uint16_t> row(w);
+    for (int y = 0; y < th; y++) {
+        std::fill(row.begin(), row.end(), 0);
+        for (int j = 0; j < k; j++) {
+            _impl.accum(row.data(), frame->data[0] + (size_t)(y * k + j) * frame->linesize[0], w);
+        }
+        for (int x = 0; x < tw; x++) {
+            int sum = 0;
+            for (int i = 0; i < k; i++) {
+                sum += row[x * k + i];
+            }
+            thumb[y * tw + x] = sum / (k * k);
+        }
+    }
+}
+
+int GateOutput::put_frame(int box, double stamp, AVFrame *frame) {
+    State &s = __states[box];
+    __thumb(frame, s.curr);
+
+    if (s.stamp >= 0 && s.curr.size() == s.thumb.size() && !s.curr.empty() &&
+            stamp - s.stamp < __cfg.max_gap) {
+        double diff = (double)sad_u8(s.curr.data(), s.thumb.data(), s.curr.size()) / s.curr.size();
+        if (diff < __cfg.threshold) {
+            // 保留引用，结束时输出
+            if (!s.tail) s.tail = av_frame_alloc();
+            av_frame_unref(s.tail);
+            if (av_frame_ref(s.tail, frame) < 0) {
+                av_frame_free(&s.tail);
+            }
+            s.tail_stamp = stamp;
+            return 1;
+        }
+    }
+
+    s.thumb.swap(s.curr);
+    s.stamp = stamp;
+    if (s.tail) {
+        av_frame_unref(s.tail);
+    }
+    return __out->put_frame(box, stamp, frame);
+}
+
+int GateOutput::close() {
+    for (int i = 0; i < __states.size(); i++) {
+        State &s = __states[i];
+        if (s.tail && s.tail->buf[0]) {
+            __out->put_frame(i, s.tail_stamp, s.tail);
+        }
+        av_frame_free(&s.tail);
+    }
+    return __out->close();
+}
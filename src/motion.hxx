@@ -0,0 +1,54 @@
+#ifndef _motion_hh
+#define _motion_hh
+
+#include "output.hxx"
+
+#include <stdint.h>
+
+/// 静止帧检测配置
+struct GateConfig {
+    float threshold = 0.0f;     // 缩小后亮度平均绝对差小于该值认为没有变化，0 不检测
+    double max_gap = 2.0;       // 最长连续跳过的秒数，超过后仍然输出一帧
+    int scale = 4;              // 亮度按 scale x scale 块平均后比较
+};
+
+/// 两段 8bit 数据的绝对差之和，运行时选择 AVX2/SSE2/标量实现
+uint64_t sad_u8(const uint8_t *a, const uint8_t *b, int n);
+const char *sad_impl_name();
+
+/// 静止帧过滤: 每个框和上次输出的帧比较缩小后的亮度，几乎相同时不交给下一级输出，put_frame 返回 1
+/// 输出时间戳不变，得到可变帧率的视频；跳过的最后一帧在 close() 时输出，保证结束时间正确
+/// 每个框的状态只在自己的 lane 中使用，和下一级输出的 lane 划分相同
+class GateOutput : public CropOutput {
+    struct State {
+        std::vector<uint8_t> thumb;     // 上次输出帧
+        std::vector<uint8_t> curr;
+        double stamp = -1.0;            // 上次输出的时间戳
+        AVFrame *tail = nullptr;        // 跳过的最后一帧
+        double tail_stamp = 0.0;
+    };
+
+    CropOutput *__out;
+    GateConfig __cfg;
+    std::vector<State> __states;
+
+public:
+    // 持有 out，析构时 delete
+    GateOutput(CropOutput *out, int boxes, const GateConfig &cfg);
+    ~GateOutput();
+
+    int lanes() const override { return __out->lanes(); }
+    int lane(int box) const override { return __out->lane(box); }
+
+    int put_frame(int box, double stamp, AVFrame *frame) override;
+    int close() override;
+
+    int64_t bytes(int box) const override { return __out->bytes(box); }
+    void set_origin(double stamp) override { __out->set_origin(stamp); }
+    std::vector<std::string> files() const override { return __out->files(); }
+
+private:
+    void __thumb(const AVFrame *frame, std::vector<uint8_t> &thumb);
+};
+
+#endif // motion.hxx
@@ -0,0 +1,295 @@
+#include "output.hxx"
+
+#include <stdio.h>
+#include <string.h>
+
+int FileOutput::open(const std::vector<Box> &boxes, const char *prefix, int width, int height, double fps,
+        bool fragmented, const EncConfig &enc, bool lazy) {
+    __w = width;
+    __h = height;
+    __fps = fps;
+    __fragmented = fragmented;
+    __enc = enc;
+    __closed = false;
+    for (int i = 0; i < boxes.size(); i++) {
+        char fname[256];
+        // 分段输出为每个框一个 hls 播放列表
+        snprintf(fname, sizeof(fname), "%s-%s-%d_%d.%s", prefix, boxes[i].title, boxes[i].x1, boxes[i].y1,
+                enc.segment > 0 ? "m3u8" : "mp4");
+        __files.push_back(fname);
+        __encoders.push_back(nullptr);
+        __failed.push_back(0);
+        if (!lazy && __open_encoder(i) < 0) {
+            close();
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int FileOutput::__open_encoder(int box) {
+    auto enc = new VideoEnc;
+    enc->configure(__enc);
+    if (enc->open(__files[box].c_str(), __w, __h, __fps, 50000, __fragmented) < 0) {
+        fprintf(stderr, "ERR: %s:%d cannot open output: %s\n", __func__, __LINE__, __files[box].c_str());
+        delete enc;
+        return -1;
+    }
+    if (__origin >= 0) {
+        enc->set_origin(__origin);
+    }
+    __encoders[box] = enc;
+    return 0;
+}
+
+void FileOutput::set_origin(double stamp) {
+    __origin = stamp;
+    for (auto enc: __encoders) {
+        if (enc) enc->set_origin(stamp);
+    }
+}
+
+int FileOutput::put_frame(int box, double stamp, AVFrame *frame) {
+    if (!__encoders[box] && (__failed[box] || __open_encoder(box) < 0)) {
+        __failed[box] = 1;
+        return -1;
+    }
+    return __encoders[box]->put_frame(stamp, frame);
+}
+
+int FileOutput::close() {
+    for (auto enc: __encoders) {
+        int64_t bytes = 0;
+        if (enc) {
+            enc->close();
+            bytes = enc->bytes();
+            delete enc;
+        }
+        __bytes.push_back(bytes);
+    }
+    __encoders.clear();
+    __closed = true;
+    return 0;
+}
+
+int64_t FileOutput::bytes(int box) const {
+    if (!__closed) {
+        // 还没有 close，不含编码器缓存的帧
+        int64_t sum = 0;
+        for (int i = 0; i < __encoders.size(); i++) {
+            if (__encoders[i] && (box < 0 || box == i)) sum += __encoders[i]->bytes();
+        }
+        return sum;
+    }
+    if (box >= 0) {
+        return box < __bytes.size() ? __bytes[box] : 0;
+    }
+    int64_t sum = 0;
+    for (auto b: __bytes) sum += b;
+    return sum;
+}
+
+//////////////////////// mux
+int MuxOutput::open(const std::vector<Box> &boxes, const char *fname, int width, int height, double fps,
+        bool fragmented, const EncConfig &cfg) {
+    __fname = fname;
+    int rc = avformat_alloc_output_context2(&__fc, NULL, NULL, fname);
+    if (rc < 0 || !__fc) {
+        fprintf(stderr, "ERR: %s:%d cannot create output avformat: %s\n", __func__, __LINE__, fname);
+        __fc = nullptr;
+        return -1;
+    }
+
+    // 容器写 SPS/PPS，编码器不在关键帧中重复
+    EncConfig enc_cfg = cfg;
+    enc_cfg.global_header = true;
+    for (int i = 0; i < boxes.size(); i++) {
+        auto enc = new VideoEnc;
+        enc->configure(enc_cfg);
+        // 编码器只在自己的 lane 中使用，packet 在 put_frame/close 的调用中写入
+        auto sink = [this, i](AVPacket *pkt) {
+            return __write(i, pkt);
+        };
+        if (enc->open(sink, width, height, fps, 50000) < 0) {
+            fprintf(stderr, "ERR: %s:%d cannot open encoder for box %d\n", __func__, __LINE__, i);
+            delete enc;
+            return -1;
+        }
+        __encoders.push_back(enc);
+
+        AVStream *st = avformat_new_stream(__fc, 0);
+        if (!st) {
+            fprintf(stderr, "ERR: %s:%d cannot create new stream!\n", __func__, __LINE__);
+            return -1;
+        }
+        enc->params(st->codecpar);
+        st->time_base = (AVRational){ 1, 90000 };
+
+        const Box &b = boxes[i];
+        char buf[128];
+        snprintf(buf, sizeof(buf), "%s-%d_%d", b.title, b.x1, b.y1);
+        av_dict_set(&st->metadata, "title", buf, 0);
+        snprintf(buf, sizeof(buf), "%d,%d,%d,%d", b.x1, b.y1, b.x2, b.y2);
+        av_dict_set(&st->metadata, "box", buf, 0);
+        av_dict_set(&st->metadata, "class", b.title, 0);
+        snprintf(buf, sizeof(buf), "%.03f", b.score);
+        av_dict_set(&st->metadata, "score", buf, 0);
+
+        char key[32];
+        snprintf(key, sizeof(key), "box_%d", i);
+        snprintf(buf, sizeof(buf), "%s %.03f %d %d %d %d", b.title, b.score, b.x1, b.y1, b.x2, b.y2);
+        av_dict_set(&__fc->metadata, key, buf, 0);
+    }
+
+    rc = avio_open(&__fc->pb, fname, AVIO_FLAG_WRITE);
+    if (rc < 0) {
+        fprintf(stderr, "ERR: %s:%d failed to open write file: %s\n", __func__, __LINE__, fname);
+        return -1;
+    }
+
+    AVDictionary *opts = nullptr;
+    const char *name = __fc->oformat->name;
+    if (strstr(name, "mp4") || strstr(name, "mov")) {
+        // mp4 只有带 use_metadata_tags 时才写入自定义的容器 metadata
+        av_dict_set(&opts, "movflags", fragmented ? "use_metadata_tags+frag_keyframe+empty_moov+default_base_moof"
+                : "use_metadata_tags", 0);
+        if (fragmented) {
+            av_dict_set(&opts, "flush_packets", "1", 0);
+        }
+    }
+    rc = avformat_write_header(__fc, &opts);
+    av_dict_free(&opts);
+    if (rc < 0) {
+        fprintf(stderr, "ERR: %s:%d failed to write head: %s\n", __func__, __LINE__, fname);
+        return -1;
+    }
+    __header = true;
+    return 0;
+}
+
+int MuxOutput::__write(int box, AVPacket *pkt) {
+    std::lock_guard<std::mutex> lock(__lock);
+    AVStream *st = __fc->streams[box];
+    av_packet_rescale_ts(pkt, (AVRational){ 1, 90000 }, st->time_base);
+    pkt->stream_index = box;
+    // 交错写入会接管 packet 的引用，编码器复用的 packet 不受影响
+    int rc = av_interleaved_write_frame(__fc, pkt);
+    if (rc < 0) {
+        fprintf(stderr, "ERR: %s:%d write packet failed for box %d\n", __func__, __LINE__, box);
+        return -1;
+    }
+    return 0;
+}
+
+void MuxOutput::set_origin(double stamp) {
+    std::lock_guard<std::mutex> lock(__lock);
+    __origin = stamp;
+    for (auto enc: __encoders) {
+        enc->set_origin(stamp);
+    }
+}
+
+int MuxOutput::put_frame(int box, double stamp, AVFrame *frame) {
+    {
+        // 所有流使用第一个到达的帧作为起点，其他 lane 的第一帧不早于它
+        std::lock_guard<std::mutex> lock(__lock);
+        if (__origin < 0) {
+            __origin = stamp;
+            for (auto enc: __encoders) {
+                enc->set_origin(stamp);
+            }
+        }
+    }
+    return __encoders[box]->put_frame(stamp, frame);
+}
+
+int MuxOutput::close() {
+    // 先 flush 所有编码器，剩余的 packet 写入后才能写 trailer
+    for (auto enc: __encoders) {
+        enc->close();
+        __bytes.push_back(enc->bytes());
+        delete enc;
+    }
+    __encoders.clear();
+    if (__fc) {
+        if (__header) {
+            av_write_trailer(__fc);
+        }
+        avio_closep(&__fc->pb);
+        avformat_free_context(__fc);
+        __fc = nullptr;
+    }
+    return 0;
+}
+
+int64_t MuxOutput::bytes(int box) const {
+    if (!__encoders.empty()) {
+        int64_t sum = 0;
+        for (int i = 0; i < __encoders.size(); i++) {
+            if (box < 0 || box == i) sum += __encoders[i]->bytes();
+        }
+        return sum;
+    }
+    if (box >= 0) {
+        return box < __bytes.size() ? __bytes[box] : 0;
+    }
+    int64_t sum = 0;
+    for (auto b: __bytes) sum += b;
+    return sum;
+}
+
+//////////////////////// levels
+LevelOutput::~LevelOutput() {
+    for (auto out: __outs) {
+        delete out;
+    }
+}
+
+void LevelOutput::add(CropOutput *out) {
+    __lane_off.push_back(lanes());
+    __outs.push_back(out);
+}
+
+int LevelOutput::lanes() const {
+    return __outs.empty() ? 0 : __lane_off.back() + __outs.back()->lanes();
+}
+
+int LevelOutput::lane(int box) const {
+    int k = box / __boxes;
+    return __lane_off[k] + __outs[k]->lane(box % __boxes);
+}
+
+int LevelOutput::put_frame(int box, double stamp, AVFrame *frame) {
+    return __outs[box / __boxes]->put_frame(box % __boxes, stamp, frame);
+}
+
+int LevelOutput::close() {
+    for (auto out: __outs) {
+        out->close();
+    }
+    return 0;
+}
+
+int64_t LevelOutput::bytes(int box) const {
+    if (box >= 0) {
+        return __outs[box / __boxes]->bytes(box % __boxes);
+    }
+    int64_t sum = 0;
+    for (auto out: __outs) sum += out->bytes(-1);
+    return sum;
+}
+
+void LevelOutput::set_origin(double stamp) {
+    for (auto out: __outs) {
+        out->set_origin(stamp);
+    }
+}
+
+std::vector<std::string> LevelOutput::files() const {
+    std::vector<std::string> files;
+    for (auto out: __outs) {
+        auto f = out->files();
+        files.insert(files.end(), f.begin(), f.end());
+    }
+    return files;
+}
@@ -0,0 +1,125 @@
+#ifndef _crop_output_hh
+#define _crop_output_hh
+
+#include "media.hxx"
+
+#include <vector>
+#include <string>
+#include <mutex>
+
+/// crop 结果的输出方式
+/// 框按 lane(box) 分组，同一 lane 的 put_frame 在同一线程中按时间顺序调用，不同 lane 可以并行
+class CropOutput {
+public:
+    virtual ~CropOutput() {}
+
+    virtual int lanes() const = 0;
+    virtual int lane(int box) const = 0;
+
+    // frame 只在调用期间有效，需要保存时使用 av_frame_ref
+    // 返回 0 已输出，> 0 有意跳过（如静止帧），< 0 失败
+    virtual int put_frame(int box, double stamp, AVFrame *frame) = 0;
+    virtual int close() = 0;
+
+    // 输出的字节数，box < 0 为总数；不能按框区分的输出只有总数，close() 之后仍然有效
+    virtual int64_t bytes(int box) const { return 0; }
+
+    // 输出时间戳的起点，默认取第一帧；分段处理时各段使用同一起点，拼接时不需要改时间戳
+    virtual void set_origin(double stamp) {}
+    // 输出的视频文件，按框的顺序
+    virtual std::vector<std::string> files() const { return {}; }
+};
+
+/// 每个框一个 h264 文件: <prefix>-<cls>-<x1>_<y1>.mp4，每个框一个 lane
+/// enc.segment > 0 时为 <prefix>-<cls>-<x1>_<y1>.m3u8 及其分段
+/// lazy: 编码器在该框的第一帧时才打开（在 lane 的线程中），没有帧的框不占用编码器
+class FileOutput : public CropOutput {
+    std::vector<VideoEnc *> __encoders;
+    std::vector<int64_t> __bytes;   // close() 时保存
+    std::vector<std::string> __files;
+
+    // lazy 打开时使用
+    int __w = 0, __h = 0;
+    double __fps = 25;
+    bool __fragmented = false;
+    EncConfig __enc;
+    double __origin = -1.0;
+    bool __closed = false;
+    std::vector<char> __failed;     // 打开失败的框不再重试
+
+public:
+    int open(const std::vector<Box> &boxes, const char *prefix, int width, int height, double fps = 25,
+            bool fragmented = false, const EncConfig &enc = EncConfig(), bool lazy = false);
+
+    int lanes() const override { return __encoders.size(); }
+    int lane(int box) const override { return box; }
+
+    int put_frame(int box, double stamp, AVFrame *frame) override;
+    int close() override;
+
+    int64_t bytes(int box) const override;
+    void set_origin(double stamp) override;
+    std::vector<std::string> files() const override { return __files; }
+
+private:
+    int __open_encoder(int box);
+};
+
+/// 所有框写入同一个容器文件 (mp4/mov/mkv)，每个框一路视频流，按时间戳交错写入
+/// 每路流的 metadata: title/box(x1,y1,x2,y2)/class/score；mp4 不保存流的自定义 metadata，
+/// 同时写入容器级的 box_<i> = "cls score x1 y1 x2 y2"
+/// 每个框一个 lane，编码并行，写容器时加锁；各路流使用同一时间起点
+class MuxOutput : public CropOutput {
+    AVFormatContext *__fc = nullptr;
+    std::vector<VideoEnc *> __encoders;
+    std::vector<int64_t> __bytes;   // close() 时保存
+    std::string __fname;
+    bool __header = false;          // 头已写入，close 时写 trailer
+
+    std::mutex __lock;              // 保护 __fc 的写入和 __origin
+    double __origin = -1.0;
+
+public:
+    // fragmented: mp4/mov 输出 fragmented mp4，见 VideoEnc::open
+    int open(const std::vector<Box> &boxes, const char *fname, int width, int height, double fps = 25,
+            bool fragmented = false, const EncConfig &enc = EncConfig());
+
+    int lanes() const override { return __encoders.size(); }
+    int lane(int box) const override { return box; }
+
+    int put_frame(int box, double stamp, AVFrame *frame) override;
+    int close() override;
+
+    int64_t bytes(int box) const override;
+    void set_origin(double stamp) override;
+    std::vector<std::string> files() const override { return { __fname }; }
+
+private:
+    int __write(int box, AVPacket *pkt);
+};
+
+/// 多级输出大小: 每级一个输出，第 k 级的框 i 为 k * boxes + i，lane 依次编号
+/// 持有各级输出，析构时 delete
+class LevelOutput : public CropOutput {
+    int __boxes;
+    std::vector<CropOutput *> __outs;
+    std::vector<int> __lane_off;
+
+public:
+    explicit LevelOutput(int boxes) : __boxes(boxes) {}
+    ~LevelOutput();
+
+    void add(CropOutput *out);
+
+    int lanes() const override;
+    int lane(int box) const override;
+
+    int put_frame(int box, double stamp, AVFrame *frame) override;
+    int close() override;
+
+    int64_t bytes(int box) const override;
+    void set_origin(double stamp) override;
+    std::vector<std::string> files() const override;
+};
+
+#endif // output.hxx
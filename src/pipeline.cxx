@@ -0,0 +1,129 @@
+#include "pipeline.hxx"
+
+#include <stdio.h>
+#include <thread>
+
+Pipeline::Pipeline(int workers, int queue_size)
+    : __workers(workers < 1 ? 1 : workers), __queue_size(queue_size < 2 ? 2 : queue_size) {
+}
+
+int Pipeline::run(VideoDec *dec, FrameCrop *cropper, CropOutput *out, RunStats *stats,
+        AVFrame *first, double stamp, double end_stamp) {
+    if (out->lanes() <= 0) {
+        fprintf(stderr, "ERR: %s:%d no outputs!\n", __func__, __LINE__);
+        return -1;
+    }
+
+    __stats = stats;
+
+    // 编码线程不多于 lane 数
+    int workers = __workers < out->lanes() ? __workers : out->lanes();
+
+    // 每个编码线程一次要接收它负责的所有 box 的帧，队列按 box 数分配，总量为 queue_size 帧 x box 数
+    std::vector<int> boxes(workers, 0);
+    for (int j = 0; j < cropper->size(); j++) {
+        boxes[out->lane(j) % workers]++;
+    }
+    RingQueue<Item> decoded(__queue_size);
+    std::vector<RingQueue<Item> *> cropped;
+    for (int i = 0; i < workers; i++) {
+        cropped.push_back(new RingQueue<Item>(__queue_size * (boxes[i] > 0 ? boxes[i] : 1)));
+    }
+
+    int frame_cnt = 0;
+    std::vector<std::thread> threads;
+    for (int i = 0; i < workers; i++) {
+        threads.emplace_back(&Pipeline::__encode, this, cropper, out, cropped[i]);
+    }
+    threads.emplace_back(&Pipeline::__crop, this, cropper, out, &decoded, &cropped);
+    threads.emplace_back(&Pipeline::__decode, this, dec, first, stamp, end_stamp, &decoded, &frame_cnt);
+
+    for (auto &th: threads) {
+        th.join();
+    }
+
+    for (auto q: cropped) {
+        delete q;
+    }
+
+    return frame_cnt;
+}
+
+void Pipeline::__decode(VideoDec *dec, AVFrame *frame, double stamp, double end_stamp,
+        RingQueue<Item> *out, int *frame_cnt) {
+    while (stamp + 0.001 < end_stamp) {
+        *frame_cnt += 1;
+        __stats->frame(stamp);
+
+        // VideoDec 内部复用 frame，需要转移引用后再交给下一级
+        AVFrame *f = __decoded.get();
+        av_frame_move_ref(f, frame);
+        if (!out->push({ stamp, f, -1 })) {
+            __decoded.put(f);
+            break;
+        }
+
+        int64_t t = now_ns();
+        int rc = dec->get_frame(&stamp, &frame);
+        __stats->decode.add(now_ns() - t);
+        if (rc == 0) {
+            // 文件结束
+            break;
+        }
+        else if (rc < 0) {
+            fprintf(stderr, "ERR: rc=%d\n", rc);
+            break;
+        }
+    }
+    out->close();
+}
+
+void Pipeline::__crop(FrameCrop *cropper, CropOutput *out, RingQueue<Item> *inp,
+        std::vector<RingQueue<Item> *> *outs) {
+    Item item;
+    int workers = outs->size();
+    while (inp->pop(item)) {
+        __stats->decoded_queue.sample(inp->size());
+
+        int64_t t = now_ns();
+        if (cropper->put(item.frame, item.stamp) >= 0) {
+            const std::vector<AVFrame *> &frames = cropper->get();
+            __stats->crop.add(now_ns() - t);
+            for (int j = 0; j < frames.size(); j++) {
+                if (!frames[j]) {
+                    __stats->box(j).failed++;
+                }
+                else if (!(*outs)[out->lane(j) % workers]->push({ item.stamp, frames[j], j })) {
+                    cropper->release(frames[j]);
+                }
+            }
+        }
+        else {
+            for (int j = 0; j < cropper->size(); j++) {
+                __stats->box(j).failed++;
+            }
+        }
+        __decoded.put(item.frame);
+    }
+    for (auto q: *outs) {
+        q->close();
+    }
+}
+
+void Pipeline::__encode(FrameCrop *cropper, CropOutput *out, RingQueue<Item> *inp) {
+    Item item;
+    while (inp->pop(item)) {
+        __stats->cropped_queue.sample(inp->size());
+
+        BoxStat &bs = __stats->box(item.box);
+        int64_t t = now_ns();
+        int rc = out->put_frame(item.box, item.stamp, item.frame);
+        t = now_ns() - t;
+        __stats->encode.add(t);
+        bs.encode.add(t);
+        if (rc < 0) bs.failed++;
+        else if (rc > 0) bs.gated++;
+        else bs.frames++;
+        cropper->release(item.frame);
+    }
+}
@@ -0,0 +1,46 @@
+#ifndef _pipeline_hh
+#define _pipeline_hh
+
+#include "media.hxx"
+#include "output.hxx"
+#include "queue.hxx"
+#include "pool.hxx"
+#include "stats.hxx"
+
+#include <vector>
+
+/// 流水线执行: 解码线程 -> crop 线程 -> N 个编码线程
+/// 各级之间通过有界环形队列连接，每个输出 lane 固定由一个编码线程负责，保证时间戳顺序
+class Pipeline {
+public:
+    struct Item {
+        double stamp;
+        AVFrame *frame;
+        int box;        // crop 之后有效
+    };
+
+private:
+    int __workers;
+    int __queue_size;
+    RunStats *__stats = nullptr;
+
+    FramePool __decoded;        // 解码线程交给 crop 线程的帧
+
+public:
+    // queue_size: 每个 box 在编码队列中最多缓存的帧数，也是解码队列长度
+    Pipeline(int workers, int queue_size = 16);
+
+    // first/stamp: 已经解码出的第一帧，处理到 end_stamp（不含）或 EOF
+    // 各阶段耗时、队列深度和进度记录到 stats
+    // 返回处理的帧数，< 0 失败
+    int run(VideoDec *dec, FrameCrop *cropper, CropOutput *out, RunStats *stats,
+            AVFrame *first, double stamp, double end_stamp);
+
+private:
+    void __decode(VideoDec *dec, AVFrame *first, double stamp, double end_stamp,
+            RingQueue<Item> *out, int *frame_cnt);
+    void __crop(FrameCrop *cropper, CropOutput *out, RingQueue<Item> *inp, std::vector<RingQueue<Item> *> *outs);
+    void __encode(FrameCrop *cropper, CropOutput *out, RingQueue<Item> *inp);
+};
+
+#endif // pipeline.hxx
@@ -0,0 +1,89 @@
+#include "pool.hxx"
+
+extern "C" {
+#   include <libavutil/imgutils.h>
+}
+
+#include <stdio.h>
+
+static const int _align = 32;
+
+FramePool::~FramePool() {
+    close();
+}
+
+int FramePool::init_video(int w, int h, AVPixelFormat fmt) {
+    for (auto &v: __videos) {
+        av_buffer_pool_uninit(&v.bufs);
+    }
+    __videos.clear();
+    return add_video(w, h, fmt);
+}
+
+int FramePool::add_video(int w, int h, AVPixelFormat fmt) {
+    int size = av_image_get_buffer_size(fmt, w, h, _align);
+    if (size <= 0) {
+        fprintf(stderr, "ERR: %s:%d invalid image: %dx%d, fmt=%d\n", __func__, __LINE__, w, h, fmt);
+        return -1;
+    }
+    __videos.push_back({ av_buffer_pool_init(size, 0), w, h, fmt });
+    return __videos.size() - 1;
+}
+
+void FramePool::close() {
+    std::lock_guard<std::mutex> lock(__lock);
+    for (auto frame: __free) {
+        av_frame_free(&frame);
+    }
+    __free.clear();
+    // 未归还的缓存在最后一个引用释放时才真正释放
+    for (auto &v: __videos) {
+        av_buffer_pool_uninit(&v.bufs);
+    }
+    __videos.clear();
+}
+
+AVFrame *FramePool::get() {
+    std::lock_guard<std::mutex> lock(__lock);
+    AVFrame *frame;
+    if (__free.empty()) {
+        frame = av_frame_alloc();
+        __total++;
+    }
+    else {
+        frame = __free.back();
+        __free.pop_back();
+    }
+    if (++__used > __high) {
+        __high = __used;
+    }
+    return frame;
+}
+
+AVFrame *FramePool::get_video(int idx) {
+    if (idx < 0 || idx >= __videos.size()) {
+        return nullptr;
+    }
+    const Video &v = __videos[idx];
+    AVFrame *frame = get();
+    frame->buf[0] = av_buffer_pool_get(v.bufs);
+    if (!frame->buf[0]) {
+        put(frame);
+        return nullptr;
+    }
+    av_image_fill_arrays(frame->data, frame->linesize, frame->buf[0]->data, v.fmt, v.w, v.h, _align);
+    frame->width = v.w;
+    frame->height = v.h;
+    frame->format = v.fmt;
+    return frame;
+}
+
+void FramePool::put(AVFrame *frame) {
+    if (!frame) return;
+    av_frame_unref(frame);
+
+    std::lock_guard<std::mutex> lock(__lock);
+    // 容量在预热后稳定，不再分配
+    __free.push_back(frame);
+    __used--;
+}
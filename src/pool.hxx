@@ -0,0 +1,49 @@
+#ifndef _frame_pool_hh
+#define _frame_pool_hh
+
+extern "C" {
+#   include <libavutil/avutil.h>
+#   include <libavutil/frame.h>
+}
+
+#include <mutex>
+#include <vector>
+
+/// AVFrame 复用池，线程安全（流水线中由 crop 线程取出，编码线程归还）
+/// get() 取出空的 AVFrame 结构，get_video() 同时从 AVBufferPool 分配像素缓存
+/// 可以有多种图像大小，每种一个 AVBufferPool，AVFrame 结构共用
+class FramePool {
+    std::mutex __lock;
+    std::vector<AVFrame *> __free;
+
+    struct Video {
+        AVBufferPool *bufs;
+        int w, h;
+        AVPixelFormat fmt;
+    };
+    std::vector<Video> __videos;
+
+    int __total = 0;        // 已创建的 AVFrame 数
+    int __used = 0;         // 当前取出未归还的数量
+    int __high = 0;         // __used 的最大值
+
+public:
+    ~FramePool();
+
+    // 设置 get_video() 的图像大小和格式，清除 add_video() 增加的大小
+    int init_video(int w, int h, AVPixelFormat fmt);
+    // 增加一种图像大小，返回 get_video() 使用的序号
+    int add_video(int w, int h, AVPixelFormat fmt);
+    void close();
+
+    AVFrame *get();
+    AVFrame *get_video(int idx = 0);
+
+    // 释放引用并归还
+    void put(AVFrame *frame);
+
+    int total() const { return __total; }
+    int high_water() const { return __high; }
+};
+
+#endif // pool.hxx
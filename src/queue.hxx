@@ -0,0 +1,80 @@
+#ifndef _ring_queue_hh
+#define _ring_queue_hh
+
+#include <atomic>
+#include <vector>
+#include <thread>
+#include <chrono>
+
+/// 单生产者/单消费者 有界无锁环形队列
+/// 满时 push 等待（背压），空时 pop 等待，close() 后 pop 取完剩余数据返回 false
+template <typename T>
+class RingQueue {
+    std::vector<T> __buf;
+    size_t __mask;
+
+    alignas(64) std::atomic<size_t> __head{0};   // 消费者读位置
+    alignas(64) std::atomic<size_t> __tail{0};   // 生产者写位置
+    alignas(64) std::atomic<bool> __closed{false};
+
+public:
+    // cap 向上取整到 2 的幂
+    explicit RingQueue(size_t cap) {
+        size_t n = 2;
+        while (n < cap) n <<= 1;
+        __buf.resize(n);
+        __mask = n - 1;
+    }
+
+    // 返回 false 表示队列已关闭
+    bool push(const T &v) {
+        size_t tail = __tail.load(std::memory_order_relaxed);
+        for (int spin = 0; tail - __head.load(std::memory_order_acquire) > __mask; spin++) {
+            if (__closed.load(std::memory_order_acquire))
+                return false;
+            __backoff(spin);
+        }
+        __buf[tail & __mask] = v;
+        __tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // 返回 false 表示队列已关闭且为空
+    bool pop(T &v) {
+        size_t head = __head.load(std::memory_order_relaxed);
+        for (int spin = 0; head == __tail.load(std::memory_order_acquire); spin++) {
+            if (__closed.load(std::memory_order_acquire)) {
+                // close 之前可能刚好 push 了
+                if (head == __tail.load(std::memory_order_acquire))
+                    return false;
+                break;
+            }
+            __backoff(spin);
+        }
+        v = __buf[head & __mask];
+        __head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    void close() {
+        __closed.store(true, std::memory_order_release);
+    }
+
+    size_t size() const {
+        return __tail.load(std::memory_order_acquire) - __head.load(std::memory_order_acquire);
+    }
+
+    size_t capacity() const {
+        return __mask + 1;
+    }
+
+private:
+    static void __backoff(int spin) {
+        if (spin < 64)
+            std::this_thread::yield();
+        else
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+    }
+};
+
+#endif // queue.hxx
@@ -0,0 +1,395 @@
+#include "resize.hxx"
+
+#include <stdio.h>
+#include <math.h>
+#include <algorithm>
+#include <utility>
+
+#if defined(__x86_64__) || defined(__i386__)
+#   include <immintrin.h>
+#   define RESIZE_X86 1
+#endif
+
+typedef void (*hpass_func)(const uint8_t *s, const int *xi, const int *wx, int n, int nsafe, uint16_t *d);
+typedef void (*vpass_func)(const uint16_t *a, const uint16_t *b, int wy, int n, uint8_t *d);
+// 区域平均: 每个目标列 taps 个源点，权重按 tap 存放 w[k * n + x]
+typedef void (*hsum_func)(const uint8_t *s, const int *xs, const int *w, int taps, int n, int nsafe, uint16_t *d);
+typedef void (*vacc_func)(const uint16_t *row, int wy, int n, uint32_t *acc);
+typedef void (*vstore_func)(const uint32_t *acc, int n, uint8_t *d);
+
+////////////////// c
+static void hpass_c(const uint8_t *s, const int *xi, const int *wx, int n, int nsafe, uint16_t *d) {
+    for (int x = 0; x < n; x++) {
+        const uint8_t *p = s + xi[x];
+        d[x] = (uint16_t)(p[0] * (256 - wx[x]) + p[1] * wx[x]);
+    }
+}
+
+static void vpass_c(const uint16_t *a, const uint16_t *b, int wy, int n, uint8_t *d) {
+    for (int x = 0; x < n; x++) {
+        d[x] = (uint8_t)((a[x] * (256 - wy) + b[x] * wy + (1 << 15)) >> 16);
+    }
+}
+
+// 权重和为 256，结果不超过 255 * 256
+static void hsum_c(const uint8_t *s, const int *xs, const int *w, int taps, int n, int nsafe, uint16_t *d) {
+    for (int x = 0; x < n; x++) {
+        const uint8_t *p = s + xs[x];
+        int sum = 0;
+        for (int k = 0; k < taps; k++) {
+            sum += p[k] * w[k * n + x];
+        }
+        d[x] = (uint16_t)sum;
+    }
+}
+
+static void vacc_c(const uint16_t *row, int wy, int n, uint32_t *acc) {
+    for (int x = 0; x < n; x++) {
+        acc[x] += (uint32_t)row[x] * wy;
+    }
+}
+
+static void vstore_c(const uint32_t *acc, int n, uint8_t *d) {
+    for (int x = 0; x < n; x++) {
+        d[x] = (uint8_t)((acc[x] + (1 << 15)) >> 16);
+    }
+}
+
+#ifdef RESIZE_X86
+////////////////// sse4.1
+// 使用 mulhi: (r * (w << 8)) >> 16 == r * w >> 8，w 在 1..255 之间不会溢出
+__attribute__((target("sse4.1")))
+static void vpass_sse41(const uint16_t *a, const uint16_t *b, int wy, int n, uint8_t *d) {
+    const __m128i f0 = _mm_set1_epi16((short)((256 - wy) << 8));
+    const __m128i f1 = _mm_set1_epi16((short)(wy << 8));
+    const __m128i round = _mm_set1_epi16(128);
+    int x = 0;
+    for (; x + 16 <= n; x += 16) {
+        __m128i v0 = _mm_add_epi16(
+                _mm_mulhi_epu16(_mm_loadu_si128((const __m128i *)(a + x)), f0),
+                _mm_mulhi_epu16(_mm_loadu_si128((const __m128i *)(b + x)), f1));
+        __m128i v1 = _mm_add_epi16(
+                _mm_mulhi_epu16(_mm_loadu_si128((const __m128i *)(a + x + 8)), f0),
+                _mm_mulhi_epu16(_mm_loadu_si128((const __m128i *)(b + x + 8)), f1));
+        v0 = _mm_srli_epi16(_mm_add_epi16(v0, round), 8);
+        v1 = _mm_srli_epi16(_mm_add_epi16(v1, round), 8);
+        _mm_storeu_si128((__m128i *)(d + x), _mm_packus_epi16(v0, v1));
+    }
+    vpass_c(a + x, b + x, wy, n - x, d + x);
+}
+
+// acc 为 32bit: row * wy 最大 65280 * 256
+__attribute__((target("sse4.1")))
+static void vacc_sse41(const uint16_t *row, int wy, int n, uint32_t *acc) {
+    const __m128i w = _mm_set1_epi32(wy);
+    int x = 0;
+    for (; x + 8 <= n; x += 8) {
+        __m128i r = _mm_loadu_si128((const __m128i *)(row + x));
+        __m128i lo = _mm_mullo_epi32(_mm_cvtepu16_epi32(r), w);
+        __m128i hi = _mm_mullo_epi32(_mm_cvtepu16_epi32(_mm_srli_si128(r, 8)), w);
+        _mm_storeu_si128((__m128i *)(acc + x), _mm_add_epi32(_mm_loadu_si128((const __m128i *)(acc + x)), lo));
+        _mm_storeu_si128((__m128i *)(acc + x + 4), _mm_add_epi32(_mm_loadu_si128((const __m128i *)(acc + x + 4)), hi));
+    }
+    vacc_c(row + x, wy, n - x, acc + x);
+}
+
+__attribute__((target("sse4.1")))
+static void vstore_sse41(const uint32_t *acc, int n, uint8_t *d) {
+    const __m128i round = _mm_set1_epi32(1 << 15);
+    int x = 0;
+    for (; x + 16 <= n; x += 16) {
+        __m128i v[4];
+        for (int i = 0; i < 4; i++) {
+            v[i] = _mm_srli_epi32(_mm_add_epi32(_mm_loadu_si128((const __m128i *)(acc + x + i * 4)), round), 16);
+        }
+        __m128i lo = _mm_packus_epi32(v[0], v[1]), hi = _mm_packus_epi32(v[2], v[3]);
+        _mm_storeu_si128((__m128i *)(d + x), _mm_packus_epi16(lo, hi));
+    }
+    vstore_c(acc + x, n - x, d + x);
+}
+
+////////////////// avx2
+__attribute__((target("avx2")))
+static void hpass_avx2(const uint8_t *s, const int *xi, const int *wx, int n, int nsafe, uint16_t *d) {
+    const __m256i mask = _mm256_set1_epi32(0xff);
+    const __m256i c256 = _mm256_set1_epi32(256);
+    int x = 0;
+    for (; x + 8 <= nsafe; x += 8) {
+        __m256i idx = _mm256_loadu_si256((const __m256i *)(xi + x));
+        __m256i w1 = _mm256_loadu_si256((const __m256i *)(wx + x));
+        __m256i w0 = _mm256_sub_epi32(c256, w1);
+        // 每个 lane 读取 s[xi], s[xi+1], ...
+        __m256i px = _mm256_i32gather_epi32((const int *)s, idx, 1);
+        __m256i p0 = _mm256_and_si256(px, mask);
+        __m256i p1 = _mm256_and_si256(_mm256_srli_epi32(px, 8), mask);
+        __m256i v = _mm256_add_epi32(_mm256_mullo_epi32(p0, w0), _mm256_mullo_epi32(p1, w1));
+        __m128i lo = _mm256_castsi256_si128(v);
+        __m128i hi = _mm256_extracti128_si256(v, 1);
+        _mm_storeu_si128((__m128i *)(d + x), _mm_packus_epi32(lo, hi));
+    }
+    hpass_c(s, xi + x, wx + x, n - x, 0, d + x);
+}
+
+__attribute__((target("avx2")))
+static void vpass_avx2(const uint16_t *a, const uint16_t *b, int wy, int n, uint8_t *d) {
+    const __m256i f0 = _mm256_set1_epi16((short)((256 - wy) << 8));
+    const __m256i f1 = _mm256_set1_epi16((short)(wy << 8));
+    const __m256i round = _mm256_set1_epi16(128);
+    int x = 0;
+    for (; x + 16 <= n; x += 16) {
+        __m256i v = _mm256_add_epi16(
+                _mm256_mulhi_epu16(_mm256_loadu_si256((const __m256i *)(a + x)), f0),
+                _mm256_mulhi_epu16(_mm256_loadu_si256((const __m256i *)(b + x)), f1));
+        v = _mm256_srli_epi16(_mm256_add_epi16(v, round), 8);
+        __m128i lo = _mm256_castsi256_si128(v);
+        __m128i hi = _mm256_extracti128_si256(v, 1);
+        _mm_storeu_si128((__m128i *)(d + x), _mm_packus_epi16(lo, hi));
+    }
+    vpass_c(a + x, b + x, wy, n - x, d + x);
+}
+
+// 每个 lane 一个目标列，逐个 tap gather 后乘权重累加
+__attribute__((target("avx2")))
+static void hsum_avx2(const uint8_t *s, const int *xs, const int *w, int taps, int n, int nsafe, uint16_t *d) {
+    const __m256i mask = _mm256_set1_epi32(0xff);
+    int x = 0;
+    for (; x + 8 <= nsafe; x += 8) {
+        __m256i idx = _mm256_loadu_si256((const __m256i *)(xs + x));
+        __m256i sum = _mm256_setzero_si256();
+        for (int k = 0; k < taps; k++) {
+            __m256i p = _mm256_and_si256(_mm256_i32gather_epi32((const int *)(s + k), idx, 1), mask);
+            __m256i wk = _mm256_loadu_si256((const __m256i *)(w + k * n + x));
+            sum = _mm256_add_epi32(sum, _mm256_mullo_epi32(p, wk));
+        }
+        __m128i lo = _mm256_castsi256_si128(sum);
+        __m128i hi = _mm256_extracti128_si256(sum, 1);
+        _mm_storeu_si128((__m128i *)(d + x), _mm_packus_epi32(lo, hi));
+    }
+    for (; x < n; x++) {
+        const uint8_t *p = s + xs[x];
+        int sum = 0;
+        for (int k = 0; k < taps; k++) {
+            sum += p[k] * w[k * n + x];
+        }
+        d[x] = (uint16_t)sum;
+    }
+}
+
+__attribute__((target("avx2")))
+static void vacc_avx2(const uint16_t *row, int wy, int n, uint32_t *acc) {
+    const __m256i w = _mm256_set1_epi32(wy);
+    int x = 0;
+    for (; x + 8 <= n; x += 8) {
+        __m256i r = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *)(row + x)));
+        __m256i a = _mm256_loadu_si256((const __m256i *)(acc + x));
+        _mm256_storeu_si256((__m256i *)(acc + x), _mm256_add_epi32(a, _mm256_mullo_epi32(r, w)));
+    }
+    vacc_c(row + x, wy, n - x, acc + x);
+}
+#endif // x86
+
+////////////////// dispatch
+struct ResizeImpl {
+    const char *name;
+    hpass_func hpass;
+    vpass_func vpass;
+    hsum_func hsum;
+    vacc_func vacc;
+    vstore_func vstore;
+
+    ResizeImpl() : name("c"), hpass(hpass_c), vpass(vpass_c), hsum(hsum_c), vacc(vacc_c), vstore(vstore_c) {
+#ifdef RESIZE_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) {
+            name = "avx2";
+            hpass = hpass_avx2;
+            vpass = vpass_avx2;
+            hsum = hsum_avx2;
+            vacc = vacc_avx2;
+            vstore = vstore_sse41;
+        }
+        else if (__builtin_cpu_supports("sse4.1")) {
+            name = "sse4.1";
+            vpass = vpass_sse41;
+            vacc = vacc_sse41;
+            vstore = vstore_sse41;
+        }
+#endif // x86
+    }
+};
+
+static const ResizeImpl _impl;
+
+const char *PlaneResizer::impl_name() {
+    return _impl.name;
+}
+
+// 像素中心对齐，计算目标坐标对应的源坐标及权重，保证 idx + 1 < sn
+static void calc_coeffs(int sn, int dn, std::vector<int> &idx, std::vector<int> &w) {
+    idx.resize(dn);
+    w.resize(dn);
+    double scale = 1.0 * sn / dn;
+    for (int i = 0; i < dn; i++) {
+        double f = (i + 0.5) * scale - 0.5;
+        if (f < 0) f = 0;
+        int n = (int)f;
+        int q = (int)((f - n) * 256 + 0.5);
+        if (n >= sn - 1) {
+            n = sn - 2;
+            q = 256;
+        }
+        idx[i] = n;
+        w[i] = q;
+    }
+}
+
+// 区域平均: 目标点覆盖 [i * scale, (i + 1) * scale)，每个源点按覆盖的长度加权
+// scale < 2 的方向仍用双线性的 2 个点（idx/wq），和另一个方向的区域平均组合
+// 所有目标点的点数补齐为相同的 t.taps（多出的权重为 0），便于向量化
+void PlaneResizer::__calc_taps(int sn, int dn, const std::vector<int> &idx, const std::vector<int> &wq, Taps &t) {
+    std::vector<std::vector<int>> ws(dn);
+    t.start.resize(dn);
+    t.taps = 2;
+    double scale = 1.0 * sn / dn;
+    for (int i = 0; i < dn; i++) {
+        std::vector<int> &w = ws[i];
+        if (scale < 2) {
+            t.start[i] = idx[i];
+            w = { 256 - wq[i], wq[i] };
+            continue;
+        }
+
+        double a = i * scale, b = (i + 1) * scale;
+        int s0 = (int)a, s1 = std::min((int)ceil(b), sn);
+        int sum = 0, big = 0;
+        for (int s = s0; s < s1; s++) {
+            double cover = std::min(b, s + 1.0) - std::max(a, (double)s);
+            int q = (int)(cover / scale * 256 + 0.5);
+            w.push_back(q);
+            sum += q;
+            if (q > w[big]) big = w.size() - 1;
+        }
+        // 舍入误差补到权重最大的点，保证和为 256
+        w[big] += 256 - sum;
+        t.start[i] = s0;
+        t.taps = std::max(t.taps, (int)w.size());
+    }
+
+    // 补齐到 taps 个点，靠近末尾的向前移动起点，不越界
+    t.w.assign((size_t)t.taps * dn, 0);
+    for (int i = 0; i < dn; i++) {
+        std::vector<int> &w = ws[i];
+        int shift = std::max(0, t.start[i] + t.taps - sn);
+        t.start[i] -= shift;
+        for (int k = 0; k < w.size(); k++) {
+            t.w[(size_t)(k + shift) * dn + i] = w[k];
+        }
+    }
+}
+
+int PlaneResizer::init(int sw, int sh, int dw, int dh) {
+    if (sw < 2 || sh < 2 || dw < 1 || dh < 1) {
+        fprintf(stderr, "ERR: %s:%d invalid size: %dx%d -> %dx%d\n", __func__, __LINE__, sw, sh, dw, dh);
+        return -1;
+    }
+    __sw = sw;
+    __sh = sh;
+    __dw = dw;
+    __dh = dh;
+
+    calc_coeffs(sw, dw, __xi, __wx);
+    calc_coeffs(sh, dh, __yi, __wy);
+
+    // gather 读 4 字节
+    __xsafe = 0;
+    while (__xsafe < dw && __xi[__xsafe] + 3 < sw)
+        __xsafe++;
+
+    for (int i = 0; i < 2; i++) {
+        __rows[i].resize(dw);
+        __row_idx[i] = -1;
+    }
+
+    __area = sw >= 2 * dw || sh >= 2 * dh;
+    if (__area) {
+        __calc_taps(sw, dw, __xi, __wx, __tx);
+        __calc_taps(sh, dh, __yi, __wy, __ty);
+        __acc.resize(dw);
+        // gather 从每个 tap 读 4 字节
+        __xsafe = 0;
+        while (__xsafe < dw && __tx.start[__xsafe] + __tx.taps + 2 < sw)
+            __xsafe++;
+    }
+    return 0;
+}
+
+const uint16_t *PlaneResizer::__hrow(const uint8_t *src, int src_stride, int y, int slot) {
+    _impl.hpass(src + (size_t)y * src_stride, __xi.data(), __wx.data(), __dw, __xsafe, __rows[slot].data());
+    __row_idx[slot] = y;
+    return __rows[slot].data();
+}
+
+void PlaneResizer::resize(const uint8_t *src, int src_stride, uint8_t *dst, int dst_stride) {
+    if (__area) {
+        __resize_area(src, src_stride, dst, dst_stride);
+        return;
+    }
+
+    // 每帧源数据都不同，行缓存只在一帧内复用
+    __row_idx[0] = __row_idx[1] = -1;
+
+    for (int y = 0; y < __dh; y++) {
+        int y0 = __yi[y], y1 = y0 + 1, wy = __wy[y];
+
+        // 向下滑动时复用上一行的结果
+        if (__row_idx[0] != y0 && __row_idx[1] == y0) {
+            __rows[0].swap(__rows[1]);
+            std::swap(__row_idx[0], __row_idx[1]);
+        }
+        const uint16_t *a = __row_idx[0] == y0 ? __rows[0].data() : __hrow(src, src_stride, y0, 0);
+        const uint16_t *b = a;
+        if (wy > 0) {
+            b = __row_idx[1] == y1 ? __rows[1].data() : __hrow(src, src_stride, y1, 1);
+        }
+
+        // 权重在端点时退化为单行
+        if (wy == 0 || wy == 256) {
+            if (wy == 256) a = b;
+            b = a;
+            wy = 128;
+        }
+        _impl.vpass(a, b, wy, __dw, dst + (size_t)y * dst_stride);
+    }
+}
+
+// 一个源行的水平结果，相邻目标行共用的源行只计算一次
+const uint16_t *PlaneResizer::__area_row(const uint8_t *src, int src_stride, int y) {
+    for (int i = 0; i < 2; i++) {
+        if (__row_idx[i] == y) {
+            __row_last = i;
+            return __rows[i].data();
+        }
+    }
+    // 源行单调递增，覆盖较早的一个
+    int slot = 1 - __row_last;
+    _impl.hsum(src + (size_t)y * src_stride, __tx.start.data(), __tx.w.data(), __tx.taps, __dw, __xsafe,
+            __rows[slot].data());
+    __row_idx[slot] = y;
+    __row_last = slot;
+    return __rows[slot].data();
+}
+
+void PlaneResizer::__resize_area(const uint8_t *src, int src_stride, uint8_t *dst, int dst_stride) {
+    const Taps &ty = __ty;
+    __row_idx[0] = __row_idx[1] = -1;
+    __row_last = 0;
+    for (int y = 0; y < __dh; y++) {
+        std::fill(__acc.begin(), __acc.end(), 0);
+        for (int j = 0; j < ty.taps; j++) {
+            int wy = ty.w[(size_t)j * __dh + y];
+            if (wy == 0) continue;
+            _impl.vacc(__area_row(src, src_stride, ty.start[y] + j), wy, __dw, __acc.data());
+        }
+        _impl.vstore(__acc.data(), __dw, dst + (size_t)y * dst_stride);
+    }
+}
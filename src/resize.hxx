@@ -0,0 +1,55 @@
+#ifndef _resize_hh
+#define _resize_hh
+
+#include <stdint.h>
+#include <vector>
+
+/// 单平面 8bit 缩放，坐标/权重在 init 时预先计算
+/// 先水平插值到 16bit 行缓存，再垂直插值写入目标
+/// 双线性: 运行时根据 CPU 选择实现，AVX2 水平（gather）和垂直都向量化，SSE4.1 只有垂直，其余为标量
+/// 任一方向缩小到 1/2 及以下时改用区域平均（按覆盖面积加权），避免双线性只取 2 个点造成的混叠；
+/// 区域平均: AVX2 水平（gather）和垂直累加都向量化，SSE4.1 只有垂直累加；相邻目标行共用的源行只做一次水平计算
+/// 非线程安全：行缓存属于对象本身
+class PlaneResizer {
+    // 每个目标点从 start 开始的 taps 个源点及权重(Q8，和为 256)，权重按 tap 存放 w[k * 目标点数 + i]
+    struct Taps {
+        std::vector<int> start;
+        int taps = 0;
+        std::vector<int> w;
+    };
+
+    int __sw = 0, __sh = 0, __dw = 0, __dh = 0;
+
+    std::vector<int> __xi, __wx;    // 每个目标列对应的源列及权重(Q8)
+    std::vector<int> __yi, __wy;    // 每个目标行对应的源行及权重(Q8)
+    int __xsafe = 0;                // 前 __xsafe 列可以一次读取 4 字节而不越界（区域平均时为最后一个 tap）
+
+    std::vector<uint16_t> __rows[2];
+    int __row_idx[2];
+    int __row_last = 0;             // 区域平均: 最近使用的行缓存
+
+    bool __area = false;
+    Taps __tx, __ty;
+    std::vector<uint32_t> __acc;
+
+public:
+    int init(int sw, int sh, int dw, int dh);
+
+    bool same_size(int sw, int sh) const { return sw == __sw && sh == __sh; }
+
+    // src 指向源平面的左上角（可以是大图中的偏移），dst 为目标平面
+    void resize(const uint8_t *src, int src_stride, uint8_t *dst, int dst_stride);
+
+    // 当前使用的实现: "avx2", "sse4.1", "c"
+    static const char *impl_name();
+    // 是否使用区域平均
+    bool area() const { return __area; }
+
+private:
+    const uint16_t *__hrow(const uint8_t *src, int src_stride, int y, int slot);
+    const uint16_t *__area_row(const uint8_t *src, int src_stride, int y);
+    void __resize_area(const uint8_t *src, int src_stride, uint8_t *dst, int dst_stride);
+    static void __calc_taps(int sn, int dn, const std::vector<int> &idx, const std::vector<int> &wq, Taps &t);
+};
+
+#endif // resize.hxx
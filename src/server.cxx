@@ -0,0 +1,250 @@
+#include "server.hxx"
+#include "batch.hxx"
+#include "chunk.hxx"
+#include "stats.hxx"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <thread>
+
+//////////////////////// conn
+Server::Conn::~Conn() {
+    ::close(fd);
+}
+
+void Server::Conn::send(const std::string &line) {
+    std::lock_guard<std::mutex> guard(lock);
+    const char *p = line.c_str();
+    size_t left = line.size();
+    while (left > 0) {
+        // 客户端已经断开时不能收到 SIGPIPE，任务继续执行
+        ssize_t n = ::send(fd, p, left, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return;
+        p += n;
+        left -= n;
+    }
+}
+
+//////////////////////// server
+Server::~Server() {
+    if (__fd >= 0) {
+        ::close(__fd);
+        unlink(__path.c_str());
+    }
+}
+
+int Server::open(const char *path) {
+    struct sockaddr_un addr;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "ERR: %s:%d socket path too long: %s\n", __func__, __LINE__, path);
+        return -1;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+
+    __fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (__fd < 0) {
+        fprintf(stderr, "ERR: %s:%d cannot create socket: %s\n", __func__, __LINE__, strerror(errno));
+        return -1;
+    }
+    unlink(path);
+    // 只允许本用户连接，socket 文件在 listen 之前设置权限
+    if (bind(__fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || chmod(path, 0600) < 0 || listen(__fd, 16) < 0) {
+        fprintf(stderr, "ERR: %s:%d cannot listen on %s: %s\n", __func__, __LINE__, path, strerror(errno));
+        ::close(__fd);
+        __fd = -1;
+        return -1;
+    }
+    __path = path;
+    return 0;
+}
+
+int Server::run(int budget, int jobs, int max_queued, ParseFn parse) {
+    if (budget <= 0) {
+        budget = std::thread::hardware_concurrency();
+        if (budget <= 0) budget = 1;
+    }
+    if (jobs <= 0) {
+        // 同 Batch: 每个任务至少分到 2 个线程
+        jobs = budget / 2 > 0 ? budget / 2 : 1;
+    }
+    __share = budget / jobs > 0 ? budget / jobs : 1;
+    __max_queued = max_queued > 0 ? max_queued : 64;
+    __parse = parse;
+
+    // 工作线程常驻，不随任务创建
+    for (int i = 0; i < jobs; i++) {
+        std::thread(&Server::__worker, this).detach();
+    }
+    fprintf(stdout, "DEBUG: serving on %s, budget %d threads, %d concurrent jobs\n", __path.c_str(), budget, jobs);
+    fflush(stdout);
+
+    while (true) {
+        int fd = accept4(__fd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            fprintf(stderr, "ERR: %s:%d accept failed: %s\n", __func__, __LINE__, strerror(errno));
+            return -1;
+        }
+        // 每个连接一个线程，连接数超过上限时直接拒绝
+        if (__conns.fetch_add(1) >= MAX_CONNS) {
+            __conns--;
+            Conn(fd).send("busy\n");
+            continue;
+        }
+        std::thread(&Server::__serve, this, std::make_shared<Conn>(fd)).detach();
+    }
+    return 0;
+}
+
+void Server::__serve(std::shared_ptr<Conn> conn) {
+    std::string buf;
+    char data[4096];
+    while (true) {
+        ssize_t n = recv(conn->fd, data, sizeof(data), 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        buf.append(data, n);
+
+        size_t pos;
+        while ((pos = buf.find('\n')) != std::string::npos) {
+            std::string line = buf.substr(0, pos);
+            buf.erase(0, pos + 1);
+            if (!line.empty() && line.back() == '\r') line.pop_back();
+            __submit(conn, &line[0]);
+        }
+        if (buf.size() > 65536) {
+            conn->send("err - request too long\n");
+            break;
+        }
+    }
+    __conns--;
+    // 还在执行的任务持有 conn，全部结束后才关闭
+}
+
+void Server::__submit(const std::shared_ptr<Conn> &conn, char *line) {
+    std::vector<std::string> tokens;
+    char *save = nullptr;
+    for (char *tok = strtok_r(line, " \t", &save); tok; tok = strtok_r(nullptr, " \t", &save)) {
+        tokens.push_back(tok);
+    }
+    if (tokens.empty()) {
+        return;
+    }
+
+    char msg[256];
+    if (tokens[0] == "stats") {
+        size_t queued;
+        {
+            std::lock_guard<std::mutex> guard(__lock);
+            queued = __queue.size();
+        }
+        snprintf(msg, sizeof(msg), "stats running %d queued %d done %d failed %d\n",
+                __running.load(), (int)queued, __done.load(), __failed.load());
+        conn->send(msg);
+        return;
+    }
+    if (tokens[0] != "job" || tokens.size() < 3) {
+        conn->send("err - usage: job <priority> <args...>\n");
+        return;
+    }
+
+    auto job = std::make_shared<Job>();
+    job->priority = atoi(tokens[1].c_str());
+    job->conn = conn;
+    job->args.push_back("crop_vid");
+    job->args.insert(job->args.end(), tokens.begin() + 2, tokens.end());
+
+    std::vector<char *> argv;
+    for (auto &a: job->args) {
+        argv.push_back(&a[0]);
+    }
+    argv.push_back(nullptr);
+    if (__parse(&job->opts, job->args.size(), argv.data()) < 0 || job->opts.inp_fname.empty()) {
+        conn->send("err - invalid job args\n");
+        return;
+    }
+    if (job->opts.batch_fname || job->opts.serve_path) {
+        conn->send("err - -batch/-serve not allowed in a job\n");
+        return;
+    }
+    share_threads(&job->opts, __share);
+    // -chunks 在任务自己的份额内再分，不能按全局预算
+    job->opts.budget = __share;
+
+    {
+        std::lock_guard<std::mutex> guard(__lock);
+        if ((int)__queue.size() >= __max_queued) {
+            conn->send("busy\n");
+            return;
+        }
+        job->id = __next_id++;
+        __queue.push(job);
+        // 在锁内应答，保证 accepted 在该任务的其它应答之前
+        snprintf(msg, sizeof(msg), "accepted %lld\n", (long long)job->id);
+        conn->send(msg);
+    }
+    __cond.notify_one();
+}
+
+void Server::__worker() {
+    while (true) {
+        std::shared_ptr<Job> job;
+        {
+            std::unique_lock<std::mutex> guard(__lock);
+            __cond.wait(guard, [this] { return !__queue.empty(); });
+            job = __queue.top();
+            __queue.pop();
+        }
+        __running++;
+        __run_job(*job);
+        __running--;
+    }
+}
+
+void Server::__run_job(Job &job) {
+    Opts &opts = job.opts;
+    Conn *conn = job.conn.get();
+    long long id = job.id;
+    double from = opts.from, duration = opts.duration;
+
+    opts.on_progress = [conn, id, from, duration](int64_t frames, double stamp, double fps) {
+        double pct = duration > 0 ? (stamp - from) * 100.0 / duration : 0.0;
+        if (pct < 0) pct = 0;
+        if (pct > 100) pct = 100;
+        char msg[256];
+        snprintf(msg, sizeof(msg), "progress %lld %lld %.3f %.1f %.1f\n", id, (long long)frames, stamp, pct, fps);
+        conn->send(msg);
+    };
+    opts.on_report = [conn, id](const std::string &json) {
+        // 一条报告一行
+        std::string line = "report " + std::to_string(id) + " " + json;
+        while (!line.empty() && line.back() == '\n') line.pop_back();
+        for (auto &c: line) {
+            if (c == '\n') c = ' ';
+        }
+        conn->send(line + "\n");
+    };
+
+    fprintf(stdout, "DEBUG: job #%lld begin: %s, priority %d\n", id, opts.inp_fname.c_str(), job.priority);
+    int64_t start = now_ns();
+    int rc = run_chunked(opts);
+    double sec = (now_ns() - start) / 1e9;
+    if (rc != 0) {
+        fprintf(stderr, "ERR: %s:%d job #%lld %s failed, rc=%d\n", __func__, __LINE__, id, opts.inp_fname.c_str(), rc);
+        __failed++;
+    }
+    __done++;
+
+    char msg[128];
+    snprintf(msg, sizeof(msg), "done %lld %d %.3f\n", id, rc, sec);
+    conn->send(msg);
+}
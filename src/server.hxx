@@ -0,0 +1,88 @@
+#ifndef _crop_server_hh
+#define _crop_server_hh
+
+#include "job.hxx"
+
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <vector>
+
+/// 守护进程: 监听本机 Unix socket，接收裁剪任务，在常驻的工作线程中按优先级执行
+/// 进程和工作线程常驻，省去每个任务的进程启动、libav 初始化和线程创建
+/// 请求每行一条（\n 结尾），一个连接上可以提交多个任务:
+///     job <priority> <参数...>    参数与单次运行的命令行相同（不含程序名，空格分隔，不支持引号）
+///     stats                       服务状态
+/// 应答每行一条，同一连接上多个任务的应答交错:
+///     accepted <id> | busy | err <id|-> <原因>    连接数超过上限时应答 busy 后关闭
+///     progress <id> <帧数> <时间戳> <百分比> <fps>
+///     report <id> <json>          运行报告（单行），分段处理时每段一条
+///     done <id> <rc> <秒>
+///     stats running <n> queued <n> done <n> failed <n>
+/// priority 越大越先执行，相同时先到先执行
+class Server {
+public:
+    // 解析一个任务的参数，argv[0] 为程序名，同命令行
+    typedef std::function<int(Opts *opts, int argc, char **argv)> ParseFn;
+
+private:
+    struct Conn {
+        int fd;
+        std::mutex lock;        // 多个任务的应答不能交叉写
+        explicit Conn(int f) : fd(f) {}
+        ~Conn();
+        void send(const std::string &line);
+    };
+
+    struct Job {
+        int64_t id;
+        int priority;
+        std::vector<std::string> args;  // opts 中的字符串指针指向这里
+        Opts opts;
+        std::shared_ptr<Conn> conn;
+    };
+
+    struct Later {
+        bool operator()(const std::shared_ptr<Job> &a, const std::shared_ptr<Job> &b) const {
+            return a->priority != b->priority ? a->priority < b->priority : a->id > b->id;
+        }
+    };
+
+    int __fd = -1;
+    std::string __path;
+    ParseFn __parse;
+    int __share = 1;            // 每个任务的线程数
+    int __max_queued = 64;
+    static const int MAX_CONNS = 64;   // 同时打开的连接数上限
+    std::atomic<int> __conns{0};
+
+    std::mutex __lock;
+    std::condition_variable __cond;
+    std::priority_queue<std::shared_ptr<Job>, std::vector<std::shared_ptr<Job>>, Later> __queue;
+    int64_t __next_id = 0;
+    std::atomic<int> __running{0}, __done{0}, __failed{0};
+
+public:
+    ~Server();
+
+    // path 已存在时先删除（上次退出留下的）
+    int open(const char *path);
+
+    // budget: 总线程数，默认 cpu 数；jobs: 同时执行的任务数，0 根据 budget 决定
+    // max_queued: 排队的任务数上限，超过时应答 busy
+    // 一直运行，accept 失败时返回 -1
+    int run(int budget, int jobs, int max_queued, ParseFn parse);
+
+private:
+    void __serve(std::shared_ptr<Conn> conn);
+    void __submit(const std::shared_ptr<Conn> &conn, char *line);
+    void __worker();
+    void __run_job(Job &job);
+};
+
+#endif // server.hxx
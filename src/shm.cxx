@@ -0,0 +1,263 @@
+#include "shm.hxx"
+
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <chrono>
+#include <thread>
+
+static size_t align64(size_t v) {
+    return (v + 63) & ~(size_t)63;
+}
+
+// 跨进程使用，不能用 FUTEX_PRIVATE_FLAG
+static int futex_wait(std::atomic<uint32_t> *addr, uint32_t val, int timeout_ms) {
+    struct timespec ts = { timeout_ms / 1000, (timeout_ms % 1000) * 1000000L };
+    return syscall(SYS_futex, (uint32_t *)addr, FUTEX_WAIT, val, &ts, 0, 0);
+}
+
+static void futex_wake(std::atomic<uint32_t> *addr) {
+    syscall(SYS_futex, (uint32_t *)addr, FUTEX_WAKE, INT_MAX, 0, 0, 0);
+}
+
+//////////////////////// writer
+int ShmOutput::open(const std::vector<Box> &boxes, const char *name, int w, int h, int slots, bool block) {
+    if (slots < 2) slots = 2;
+
+    size_t y = (size_t)w * h, uv = (size_t)((w + 1) / 2) * ((h + 1) / 2);
+    size_t slot_size = align64(sizeof(ShmSlot)) + align64(y) + 2 * align64(uv);
+    __size = align64(sizeof(ShmRingHeader)) + slot_size * slots;
+    __name = name;
+
+    // 不删除已有的同名共享内存: 可能属于同时运行的其它任务；上次异常退出留下的需要手工删除
+    __fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0644);
+    if (__fd < 0 && errno == EEXIST) {
+        fprintf(stderr, "ERR: %s:%d shm %s already exists (in use, or left by a crash: rm /dev/shm%s)\n",
+                __func__, __LINE__, name, name);
+        return -1;
+    }
+    if (__fd < 0 || ftruncate(__fd, __size) < 0) {
+        fprintf(stderr, "ERR: %s:%d cannot create shm: %s\n", __func__, __LINE__, name);
+        close();
+        return -1;
+    }
+    void *map = mmap(0, __size, PROT_READ | PROT_WRITE, MAP_SHARED, __fd, 0);
+    if (map == MAP_FAILED) {
+        fprintf(stderr, "ERR: %s:%d mmap shm %s failed\n", __func__, __LINE__, name);
+        close();
+        return -1;
+    }
+    __map = (uint8_t *)map;
+
+    // ftruncate 得到的内存为 0，原子变量的初值即为 0
+    __head = (ShmRingHeader *)__map;
+    __head->version = 1;
+    __head->slots = slots;
+    __head->slot_size = slot_size;
+    __head->width = w;
+    __head->height = h;
+    __head->boxes = boxes.size();
+    __head->block = block;
+    for (int i = 0; i < slots; i++) {
+        ShmSlot *slot = (ShmSlot *)(__map + align64(sizeof(ShmRingHeader)) + slot_size * i);
+        slot->width = w;
+        slot->height = h;
+        slot->linesize[0] = w;
+        slot->linesize[1] = slot->linesize[2] = (w + 1) / 2;
+        slot->offset[0] = align64(sizeof(ShmSlot));
+        slot->offset[1] = slot->offset[0] + align64(y);
+        slot->offset[2] = slot->offset[1] + align64(uv);
+    }
+    // 最后写入 magic，读端看到 magic 后其它字段有效
+    std::atomic_thread_fence(std::memory_order_release);
+    memcpy(__head->magic, "CSHM", 4);
+    return 0;
+}
+
+int ShmOutput::put_frame(int box, double stamp, AVFrame *frame) {
+    ShmRingHeader *head = __head;
+    uint64_t seq = head->write_seq.load(std::memory_order_relaxed);
+
+    if (head->block) {
+        uint64_t read = head->read_seq.load(std::memory_order_acquire);
+        if (__stalled && seq - read < head->slots) {
+            // 读端又开始读取
+            __stalled = false;
+        }
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(BLOCK_TIMEOUT_MS);
+        while (!__stalled && seq - read >= head->slots) {
+            if (std::chrono::steady_clock::now() > deadline) {
+                fprintf(stderr, "WARN: %s:%d no reader progress on %s for %d ms, overwrite old frames\n",
+                        __func__, __LINE__, __name.c_str(), BLOCK_TIMEOUT_MS);
+                __stalled = true;
+                break;
+            }
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+            uint64_t r = head->read_seq.load(std::memory_order_acquire);
+            if (r != read) {
+                // 读端还在读取，重新计时
+                read = r;
+                deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(BLOCK_TIMEOUT_MS);
+            }
+        }
+    }
+
+    uint8_t *base = __map + align64(sizeof(ShmRingHeader)) + (size_t)head->slot_size * (seq % head->slots);
+    ShmSlot *slot = (ShmSlot *)base;
+    slot->seq.store(0, std::memory_order_release);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    slot->box = box;
+    slot->stamp = stamp;
+    for (int p = 0; p < 3; p++) {
+        int w = p ? (slot->width + 1) / 2 : slot->width, h = p ? (slot->height + 1) / 2 : slot->height;
+        uint8_t *dst = base + slot->offset[p];
+        for (int r = 0; r < h; r++) {
+            memcpy(dst + r * slot->linesize[p], frame->data[p] + r * frame->linesize[p], w);
+        }
+    }
+
+    slot->seq.store(seq + 1, std::memory_order_release);
+    head->write_seq.store(seq + 1, std::memory_order_release);
+    head->futex.fetch_add(1, std::memory_order_release);
+    futex_wake(&head->futex);
+    return 0;
+}
+
+int ShmOutput::close() {
+    if (__head) {
+        __head->closed.store(1, std::memory_order_release);
+        __head->futex.fetch_add(1, std::memory_order_release);
+        futex_wake(&__head->futex);
+        __head = nullptr;
+    }
+    if (__map) {
+        munmap(__map, __size);
+        __map = nullptr;
+    }
+    if (__fd >= 0) {
+        ::close(__fd);
+        __fd = -1;
+        // 已经打开的读端不受影响
+        shm_unlink(__name.c_str());
+    }
+    return 0;
+}
+
+//////////////////////// reader
+int ShmReader::open(const char *name, int timeout_ms) {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+    struct stat st;
+    for (;;) {
+        __fd = shm_open(name, O_RDWR, 0);
+        if (__fd >= 0 && fstat(__fd, &st) == 0 && st.st_size >= sizeof(ShmRingHeader)) {
+            break;
+        }
+        if (__fd >= 0) {
+            ::close(__fd);
+            __fd = -1;
+        }
+        if (std::chrono::steady_clock::now() > deadline) {
+            fprintf(stderr, "ERR: %s:%d cannot open shm: %s\n", __func__, __LINE__, name);
+            return -1;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+
+    __size = st.st_size;
+    void *map = mmap(0, __size, PROT_READ | PROT_WRITE, MAP_SHARED, __fd, 0);
+    if (map == MAP_FAILED) {
+        fprintf(stderr, "ERR: %s:%d mmap shm %s failed\n", __func__, __LINE__, name);
+        close();
+        return -1;
+    }
+    __map = (uint8_t *)map;
+    __head = (ShmRingHeader *)__map;
+
+    while (memcmp(__head->magic, "CSHM", 4) != 0) {
+        if (std::chrono::steady_clock::now() > deadline) {
+            fprintf(stderr, "ERR: %s:%d invalid shm: %s\n", __func__, __LINE__, name);
+            close();
+            return -1;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+
+    // 从当前还在缓冲区中的最早一帧开始
+    uint64_t w = __head->write_seq.load(std::memory_order_acquire);
+    __next = w > __head->slots ? w - __head->slots : 0;
+    return 0;
+}
+
+void ShmReader::close() {
+    if (__map) {
+        munmap(__map, __size);
+        __map = nullptr;
+        __head = nullptr;
+    }
+    if (__fd >= 0) {
+        ::close(__fd);
+        __fd = -1;
+    }
+}
+
+int ShmReader::next(ShmFrame *frame, int timeout_ms) {
+    ShmRingHeader *head = __head;
+    // 之前的帧已处理完
+    head->read_seq.store(__next, std::memory_order_release);
+
+    for (;;) {
+        uint32_t f = head->futex.load(std::memory_order_acquire);
+        uint64_t w = head->write_seq.load(std::memory_order_acquire);
+        if (w > __next + head->slots) {
+            __lost += w - head->slots - __next;
+            __next = w - head->slots;
+        }
+        if (__next < w) {
+            break;
+        }
+        if (head->closed.load(std::memory_order_acquire)) {
+            return -1;
+        }
+        if (futex_wait(&head->futex, f, timeout_ms) < 0 && errno == ETIMEDOUT) {
+            return 0;
+        }
+    }
+
+    const uint8_t *base = __map + align64(sizeof(ShmRingHeader)) + (size_t)head->slot_size * (__next % head->slots);
+    const ShmSlot *slot = (const ShmSlot *)base;
+    if (slot->seq.load(std::memory_order_acquire) != __next + 1) {
+        // 刚好被覆盖
+        __lost++;
+        __next++;
+        return next(frame, timeout_ms);
+    }
+
+    frame->seq = __next;
+    frame->box = slot->box;
+    frame->stamp = slot->stamp;
+    frame->width = slot->width;
+    frame->height = slot->height;
+    for (int p = 0; p < 3; p++) {
+        frame->data[p] = base + slot->offset[p];
+        frame->linesize[p] = slot->linesize[p];
+    }
+    head->read_seq.store(__next, std::memory_order_release);
+    __next++;
+    return 1;
+}
+
+bool ShmReader::valid(const ShmFrame &frame) const {
+    const uint8_t *base = __map + align64(sizeof(ShmRingHeader)) + (size_t)__head->slot_size * (frame.seq % __head->slots);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return ((const ShmSlot *)base)->seq.load(std::memory_order_acquire) == frame.seq + 1;
+}
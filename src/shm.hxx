@@ -0,0 +1,98 @@
+#ifndef _shm_ring_hh
+#define _shm_ring_hh
+
+#include "output.hxx"
+
+#include <stdint.h>
+#include <atomic>
+#include <string>
+
+/// 共享内存环形缓冲区布局 (shm_open 名字由 -shm 指定):
+///     ShmRingHeader
+///     slot[slots]，每个 slot_size 字节: ShmSlot + YUV420P 数据 (Y, U, V 紧密排列)
+/// 写端不等待读端，读端太慢时旧帧被覆盖（ShmReader 统计为 lost）；
+/// block 模式下写端等待 read_seq，适用于单个读端且不能丢帧的情况
+struct ShmRingHeader {
+    char magic[4];          // "CSHM"
+    uint32_t version;       // 1
+    uint32_t slots;
+    uint32_t slot_size;
+    uint32_t width, height; // 每帧 YUV420P 大小
+    uint32_t boxes;
+    uint32_t block;
+
+    alignas(64) std::atomic<uint64_t> write_seq;    // 已发布的帧数
+    alignas(64) std::atomic<uint64_t> read_seq;     // block 模式下读端已处理到的帧
+    alignas(64) std::atomic<uint32_t> futex;        // 每次发布 +1，读端在此等待
+    std::atomic<uint32_t> closed;
+};
+
+struct ShmSlot {
+    std::atomic<uint64_t> seq;  // 帧序号 + 1，写入过程中为 0
+    int32_t box;
+    int32_t width, height;
+    int32_t linesize[3];
+    uint32_t offset[3];         // 相对 slot 起始的偏移
+    double stamp;
+};
+
+/// crop 结果逐帧发布到共享内存，本机其它进程可以直接读取，不经过文件
+class ShmOutput : public CropOutput {
+    std::string __name;
+    int __fd = -1;
+    uint8_t *__map = nullptr;
+    size_t __size = 0;
+    ShmRingHeader *__head = nullptr;
+    bool __stalled = false;     // block 模式下读端超时不动，暂时按覆盖模式写入
+
+public:
+    // block 模式下读端超过该时间没有读取（没有读端或读端已退出）时不再等待，覆盖旧帧，读端恢复后重新等待
+    static const int BLOCK_TIMEOUT_MS = 2000;
+
+    // slots: 环形缓冲区的帧数，block: 缓冲区满时等待读端
+    int open(const std::vector<Box> &boxes, const char *name, int width, int height, int slots, bool block);
+
+    // 单个写入位置，所有框使用同一个 lane
+    int lanes() const override { return 1; }
+    int lane(int box) const override { return 0; }
+
+    int put_frame(int box, double stamp, AVFrame *frame) override;
+    int close() override;
+};
+
+/// 读端得到的一帧，data 直接指向共享内存
+struct ShmFrame {
+    uint64_t seq;
+    int box;
+    double stamp;
+    int width, height;
+    const uint8_t *data[3];
+    int linesize[3];
+};
+
+/// 参考读取端
+class ShmReader {
+    int __fd = -1;
+    uint8_t *__map = nullptr;
+    size_t __size = 0;
+    ShmRingHeader *__head = nullptr;
+
+    uint64_t __next = 0;
+    uint64_t __lost = 0;
+
+public:
+    // 等待写端创建共享内存，最多 timeout_ms
+    int open(const char *name, int timeout_ms);
+    void close();
+
+    const ShmRingHeader *header() const { return __head; }
+
+    // 1 得到一帧，0 超时，< 0 写端已结束
+    // 返回的数据在下次 next() 之前有效（非 block 模式下可能被覆盖，用 valid() 检查）
+    int next(ShmFrame *frame, int timeout_ms);
+    bool valid(const ShmFrame &frame) const;
+
+    uint64_t lost() const { return __lost; }
+};
+
+#endif // shm.hxx
@@ -0,0 +1,103 @@
+#include "stats.hxx"
+
+RunStats::RunStats(int boxes, bool progress, double interval)
+    : __nboxes(boxes), __boxes(new BoxStat[boxes > 0 ? boxes : 1]), __start_ns(now_ns()),
+      __progress(progress), __interval_ns((int64_t)(interval * 1e9)) {
+}
+
+void RunStats::frame(double stamp) {
+    int64_t n = __frames.fetch_add(1, std::memory_order_relaxed) + 1;
+    if (!__progress) {
+        return;
+    }
+
+    // 每帧输出进度本身就有开销，限制输出频率
+    int64_t now = now_ns();
+    if (now - __last_progress_ns < __interval_ns) {
+        return;
+    }
+    __last_progress_ns = now;
+    double sec = (now - __start_ns) / 1e9;
+    if (__on_progress) {
+        __on_progress(n, stamp, sec > 0 ? n / sec : 0.0);
+        return;
+    }
+    fprintf(stdout, "    => frame #%05lld: %.03f seconds, %.1f fps..\r",
+            (long long)n, stamp, sec > 0 ? n / sec : 0.0);
+    fflush(stdout);
+}
+
+void RunStats::finish() {
+    __end_ns = now_ns();
+}
+
+double RunStats::seconds() const {
+    return ((__end_ns ? __end_ns : now_ns()) - __start_ns) / 1e9;
+}
+
+std::string json_escape(const std::string &s) {
+    std::string r;
+    r.reserve(s.size() + 2);
+    for (unsigned char c: s) {
+        if (c == '"' || c == '\\') {
+            r += '\\';
+            r += c;
+        }
+        else if (c < 0x20) {
+            char buf[8];
+            snprintf(buf, sizeof(buf), "\\u%04x", c);
+            r += buf;
+        }
+        else {
+            r += c;
+        }
+    }
+    return r;
+}
+
+static void write_stage(FILE *fp, const char *name, const StageStat &s) {
+    int64_t cnt = s.count.load(), ns = s.ns.load();
+    fprintf(fp, "\"%s\":{\"count\":%lld,\"total_ms\":%.3f,\"avg_us\":%.1f,\"max_us\":%.1f}",
+            name, (long long)cnt, ns / 1e6, cnt ? ns / 1e3 / cnt : 0.0, s.max_ns.load() / 1e3);
+}
+
+static void write_depth(FILE *fp, const char *name, const DepthStat &d) {
+    int64_t n = d.samples.load();
+    fprintf(fp, "\"%s\":{\"avg\":%.2f,\"max\":%lld}",
+            name, n ? (double)d.sum.load() / n : 0.0, (long long)d.max.load());
+}
+
+void RunStats::write_json(FILE *fp, const std::vector<Box> &boxes, const CropOutput *out) const {
+    double sec = seconds();
+    fprintf(fp, "\"frames\":%lld,\"skipped\":%lld,\"seconds\":%.3f,\"fps\":%.2f,\"output_bytes\":%lld,\n",
+            (long long)frames(), (long long)skipped, sec, sec > 0 ? frames() / sec : 0.0, (long long)(out ? out->bytes(-1) : 0));
+
+    fprintf(fp, "\"stages\":{");
+    write_stage(fp, "decode", decode);
+    fprintf(fp, ",");
+    write_stage(fp, "crop", crop);
+    fprintf(fp, ",");
+    write_stage(fp, "encode", encode);
+    fprintf(fp, "},\n");
+
+    fprintf(fp, "\"queues\":{");
+    write_depth(fp, "decoded", decoded_queue);
+    fprintf(fp, ",");
+    write_depth(fp, "cropped", cropped_queue);
+    fprintf(fp, "},\n");
+
+    fprintf(fp, "\"boxes\":[");
+    for (int i = 0; i < __nboxes; i++) {
+        const BoxStat &b = __boxes[i];
+        const Box *box = i < boxes.size() ? &boxes[i] : nullptr;
+        fprintf(fp, "%s\n  {\"id\":%d,\"cls\":\"%s\",\"x1\":%d,\"y1\":%d,\"x2\":%d,\"y2\":%d,"
+                "\"frames\":%lld,\"failed\":%lld,\"gated\":%lld,\"bytes\":%lld,",
+                i ? "," : "", i, box ? box->title : "", box ? box->x1 : 0, box ? box->y1 : 0,
+                box ? box->x2 : 0, box ? box->y2 : 0,
+                (long long)b.frames.load(), (long long)b.failed.load(), (long long)b.gated.load(),
+                (long long)(out ? out->bytes(i) : 0));
+        write_stage(fp, "encode", b.encode);
+        fprintf(fp, "}");
+    }
+    fprintf(fp, "]");
+}
@@ -0,0 +1,100 @@
+#ifndef _run_stats_hh
+#define _run_stats_hh
+
+#include "media.hxx"
+#include "output.hxx"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <functional>
+#include <string>
+#include <vector>
+
+/// 单调时钟，纳秒
+inline int64_t now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/// 一个阶段的耗时，可以在多个线程中同时累加
+struct StageStat {
+    std::atomic<int64_t> count{0}, ns{0}, max_ns{0};
+
+    void add(int64_t t) {
+        count.fetch_add(1, std::memory_order_relaxed);
+        ns.fetch_add(t, std::memory_order_relaxed);
+        int64_t m = max_ns.load(std::memory_order_relaxed);
+        while (t > m && !max_ns.compare_exchange_weak(m, t, std::memory_order_relaxed)) {}
+    }
+};
+
+/// 队列深度采样
+struct DepthStat {
+    std::atomic<int64_t> samples{0}, sum{0}, max{0};
+
+    void sample(int64_t v) {
+        samples.fetch_add(1, std::memory_order_relaxed);
+        sum.fetch_add(v, std::memory_order_relaxed);
+        int64_t m = max.load(std::memory_order_relaxed);
+        while (v > m && !max.compare_exchange_weak(m, v, std::memory_order_relaxed)) {}
+    }
+};
+
+/// 每个框的输出统计
+struct BoxStat {
+    std::atomic<int64_t> frames{0};     // 成功写入
+    std::atomic<int64_t> failed{0};     // crop 失败（get() 为 nullptr）或输出失败
+    std::atomic<int64_t> gated{0};      // 静止帧，输出跳过
+    StageStat encode;
+};
+
+/// 一次任务的运行统计: 各阶段耗时、队列深度、每个框的帧数和失败数，限速的进度输出
+class RunStats {
+public:
+    // 进度回调: 已解码帧数，当前帧时间戳，平均帧率
+    typedef std::function<void(int64_t frames, double stamp, double fps)> ProgressFn;
+
+    StageStat decode, crop, encode;
+    DepthStat decoded_queue, cropped_queue;    // 流水线: 解码 -> crop，crop -> 编码
+    int64_t skipped = 0;                        // 按输出帧率丢弃的帧
+
+private:
+    int __nboxes;
+    std::unique_ptr<BoxStat[]> __boxes;
+    int64_t __start_ns;
+    int64_t __end_ns = 0;
+    std::atomic<int64_t> __frames{0};
+
+    bool __progress;
+    int64_t __interval_ns;
+    int64_t __last_progress_ns = 0;
+    ProgressFn __on_progress;
+
+public:
+    // interval: 进度输出间隔，秒
+    RunStats(int boxes, bool progress, double interval = 1.0);
+
+    BoxStat &box(int i) { return __boxes[i]; }
+
+    // 进度交给回调，不再输出到 stdout，间隔仍为 interval
+    void set_progress(ProgressFn fn) { __on_progress = fn; }
+
+    // 解码得到一帧，需要时输出进度（只在解码线程调用）
+    void frame(double stamp);
+    // 处理结束
+    void finish();
+
+    int64_t frames() const { return __frames.load(std::memory_order_relaxed); }
+    double seconds() const;
+
+    // 写 json 的字段（不含外层 {}）: frames, skipped, seconds, fps, output_bytes, stages, queues, boxes
+    void write_json(FILE *fp, const std::vector<Box> &boxes, const CropOutput *out) const;
+};
+
+/// 转义为 json 字符串的内容（不含两边的引号），用于文件名等任意字符串
+std::string json_escape(const std::string &s);
+
+#endif // stats.hxx
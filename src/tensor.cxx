@@ -0,0 +1,232 @@
+#include "tensor.hxx"
+
+extern "C" {
+#   include <libswscale/swscale.h>
+}
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+int TensorOutput::open(const std::vector<Box> &boxes, const char *prefix, int width, int height, double fps,
+        const TensorConfig &cfg) {
+    if (cfg.len <= 0 || cfg.stride <= 0 || (cfg.channels != 1 && cfg.channels != 3)) {
+        fprintf(stderr, "ERR: %s:%d invalid tensor config: len=%d, stride=%d, channels=%d\n", __func__, __LINE__,
+                cfg.len, cfg.stride, cfg.channels);
+        return -1;
+    }
+    __cfg = cfg;
+    __fps = fps > 0 ? fps : 25;
+    __prefix = prefix;
+    __boxes = boxes;
+    __w = width;
+    __h = height;
+    __plane = (size_t)width * height * (cfg.f32 ? sizeof(float) : 1);
+
+    size_t off = sizeof(TensorHeader) + cfg.len * sizeof(double) + boxes.size() * 4 * sizeof(int32_t);
+    __data_offset = (off + 63) & ~(size_t)63;
+
+    __lanes.resize(boxes.size());
+    return 0;
+}
+
+TensorOutput::Clip *TensorOutput::__get_clip(int idx) {
+    std::lock_guard<std::mutex> lock(__lock);
+    auto it = __clips.find(idx);
+    if (it != __clips.end()) {
+        return &it->second;
+    }
+
+    char fname[512];
+    snprintf(fname, sizeof(fname), "%s-clip%04d.tensor", __prefix.c_str(), idx);
+    size_t size = __data_offset + __boxes.size() * __cfg.len * __cfg.channels * __plane;
+
+    int fd = ::open(fname, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0 || ftruncate(fd, size) < 0) {
+        fprintf(stderr, "ERR: %s:%d cannot create tensor file: %s\n", __func__, __LINE__, fname);
+        if (fd >= 0) ::close(fd);
+        return nullptr;
+    }
+    void *map = mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        fprintf(stderr, "ERR: %s:%d mmap %s failed\n", __func__, __LINE__, fname);
+        ::close(fd);
+        return nullptr;
+    }
+
+    TensorHeader *head = (TensorHeader *)map;
+    memcpy(head->magic, "CTEN", 4);
+    head->version = 1;
+    head->dtype = __cfg.f32 ? 1 : 0;
+    head->n = __boxes.size();
+    head->t = __cfg.len;
+    head->c = __cfg.channels;
+    head->h = __h;
+    head->w = __w;
+    head->stride = __cfg.stride;
+    head->frames = 0;
+    head->clip = idx;
+    head->data_offset = __data_offset;
+    strncpy(head->pix_fmt, __cfg.channels == 1 ? "gray" : (__cfg.bgr ? "bgr" : "rgb"), sizeof(head->pix_fmt));
+    memcpy(head->mean, __cfg.mean, sizeof(head->mean));
+    memcpy(head->std, __cfg.std, sizeof(head->std));
+
+    int32_t *boxes = (int32_t *)((uint8_t *)map + sizeof(TensorHeader) + __cfg.len * sizeof(double));
+    for (int i = 0; i < __boxes.size(); i++) {
+        boxes[i*4] = __boxes[i].x1;
+        boxes[i*4+1] = __boxes[i].y1;
+        boxes[i*4+2] = __boxes[i].x2;
+        boxes[i*4+3] = __boxes[i].y2;
+    }
+
+    Clip &clip = __clips[idx];
+    clip = { fd, (uint8_t *)map, size };
+    return &clip;
+}
+
+void TensorOutput::__finish_clip(int idx, Clip &clip, int frames) {
+    ((TensorHeader *)clip.map)->frames = frames;
+    munmap(clip.map, clip.size);
+    ::close(clip.fd);
+}
+
+// 写入一帧的 c 个通道，dst 指向该帧第一个通道
+void TensorOutput::__convert(Lane &lane, AVFrame *frame, uint8_t *dst) {
+    int w = __w, h = __h;
+    size_t pixels = (size_t)w * h;
+
+    uint8_t *planes[3];
+    int strides[3] = { w, w, w };
+    if (__cfg.channels == 1) {
+        // 直接使用 Y 平面
+        if (!__cfg.f32) {
+            for (int y = 0; y < h; y++) {
+                memcpy(dst + y * w, frame->data[0] + y * frame->linesize[0], w);
+            }
+            return;
+        }
+        float *out = (float *)dst;
+        for (int y = 0; y < h; y++) {
+            const uint8_t *src = frame->data[0] + y * frame->linesize[0];
+            for (int x = 0; x < w; x++) {
+                out[y * w + x] = (src[x] / 255.f - __cfg.mean[0]) / __cfg.std[0];
+            }
+        }
+        return;
+    }
+
+    lane.sws = sws_getCachedContext(lane.sws, frame->width, frame->height, (AVPixelFormat)frame->format,
+            w, h, AV_PIX_FMT_GBRP, SWS_BILINEAR, 0, 0, 0);
+
+    // GBRP 平面顺序为 G, B, R
+    int r = __cfg.bgr ? 2 : 0, b = __cfg.bgr ? 0 : 2;
+    uint8_t *base = dst;
+    if (__cfg.f32) {
+        lane.tmp.resize(pixels * 3);
+        base = lane.tmp.data();
+    }
+    size_t step = __cfg.f32 ? pixels : __plane;
+    planes[0] = base + 1 * step;
+    planes[1] = base + b * step;
+    planes[2] = base + r * step;
+    sws_scale(lane.sws, frame->data, frame->linesize, 0, frame->height, planes, strides);
+
+    if (__cfg.f32) {
+        float *out = (float *)dst;
+        for (int c = 0; c < 3; c++) {
+            const uint8_t *src = base + c * pixels;
+            float m = __cfg.mean[c], s = __cfg.std[c];
+            for (size_t i = 0; i < pixels; i++) {
+                out[c * pixels + i] = (src[i] / 255.f - m) / s;
+            }
+        }
+    }
+}
+
+void TensorOutput::set_origin(double stamp) {
+    std::lock_guard<std::mutex> lock(__lock);
+    __origin = stamp;
+}
+
+int TensorOutput::put_frame(int box, double stamp, AVFrame *frame) {
+    Lane &lane = __lanes[box];
+    double origin;
+    int64_t next;
+    {
+        // 没有 set_origin 时取第一个到达的帧
+        std::lock_guard<std::mutex> lock(__lock);
+        if (__origin < 0) __origin = stamp;
+        origin = __origin;
+        next = lane.next;
+    }
+
+    // 帧序号由时间戳得到，不依赖该框收到的帧数，crop 失败的帧不会让各框错开
+    int64_t n = llround((stamp - origin) * __fps);
+    if (n < 0 || n % __cfg.stride) {
+        return 0;
+    }
+    int64_t step = n / __cfg.stride;
+    if (step < next) {
+        // 可变帧率时两帧落在同一时间步
+        return 0;
+    }
+
+    int idx = step / __cfg.len, t = step % __cfg.len;
+    Clip *clip = __get_clip(idx);
+    if (!clip) {
+        return -1;
+    }
+
+    // 不同框写入相同的时间戳
+    double *stamps = (double *)(clip->map + sizeof(TensorHeader));
+    stamps[t] = stamp;
+
+    size_t frame_size = __cfg.channels * __plane;
+    uint8_t *dst = clip->map + __data_offset + ((size_t)box * __cfg.len + t) * frame_size;
+    __convert(lane, frame, dst);
+
+    std::lock_guard<std::mutex> lock(__lock);
+    lane.next = step + 1;
+    __finish_ready();
+    return 0;
+}
+
+// 所有框都已经写过的 clip 完成，需要持有 __lock
+void TensorOutput::__finish_ready() {
+    int64_t done = INT64_MAX;
+    for (auto &l: __lanes) {
+        done = l.next < done ? l.next : done;
+    }
+    for (auto it = __clips.begin(); it != __clips.end(); ) {
+        if ((int64_t)(it->first + 1) * __cfg.len > done) {
+            break;
+        }
+        __finish_clip(it->first, it->second, __cfg.len);
+        it = __clips.erase(it);
+    }
+}
+
+int TensorOutput::close() {
+    std::lock_guard<std::mutex> lock(__lock);
+    for (auto &kv: __clips) {
+        // 有效帧数取所有框中最多的，缺失的帧为 0
+        int frames = 0;
+        for (auto &lane: __lanes) {
+            int64_t n = lane.next - (int64_t)kv.first * __cfg.len;
+            n = n < 0 ? 0 : (n > __cfg.len ? __cfg.len : n);
+            frames = n > frames ? n : frames;
+        }
+        __finish_clip(kv.first, kv.second, frames);
+    }
+    __clips.clear();
+
+    for (auto &lane: __lanes) {
+        sws_freeContext(lane.sws);
+        lane.sws = nullptr;
+    }
+    return 0;
+}
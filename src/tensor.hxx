@@ -0,0 +1,94 @@
+#ifndef _tensor_output_hh
+#define _tensor_output_hh
+
+#include "output.hxx"
+
+#include <stdint.h>
+#include <map>
+#include <mutex>
+
+struct SwsContext;
+
+/// 张量输出配置
+struct TensorConfig {
+    int len = 16;           // 每个 clip 的帧数 T
+    int stride = 1;         // 每 stride 帧取一帧
+    int channels = 3;       // 3: rgb/bgr, 1: gray (Y)
+    bool bgr = false;
+    bool f32 = false;       // float32，(v / 255 - mean) / std
+    float mean[3] = { 0.f, 0.f, 0.f };
+    float std[3] = { 1.f, 1.f, 1.f };
+};
+
+/// 张量文件头，小端，之后依次为:
+///     double stamps[t]            每个时间步的时间戳
+///     int32_t boxes[n][4]         x1 y1 x2 y2
+///     data (data_offset 处)       [n][t][c][h][w]，uint8 或 float32
+struct TensorHeader {
+    char magic[4];          // "CTEN"
+    uint32_t version;       // 1
+    uint32_t dtype;         // 0: uint8, 1: float32
+    uint32_t n, t, c, h, w;
+    uint32_t stride;
+    uint32_t frames;        // 有效的时间步数，最后一个 clip 可能小于 t
+    uint32_t clip;          // clip 序号
+    uint32_t padding;
+    uint64_t data_offset;
+    char pix_fmt[8];        // "rgb", "bgr", "gray"
+    float mean[3], std[3];
+    uint8_t reserved[40];
+};
+
+static_assert(sizeof(TensorHeader) == 128, "tensor header must be 128 bytes");
+
+/// crop 结果直接写成模型输入用的张量文件 <prefix>-clip<NNNN>.tensor，不经过编码
+/// 每个文件为一个 clip: 所有框的 T 帧，文件 mmap 后直接写入
+/// 每个框一个 lane，写入文件中各自的区域，可以并行
+/// 时间步由时间戳计算: 第 n 帧 n = (stamp - origin) * fps，n % stride == 0 时取为第 n / stride 步，
+/// 某个框的 crop 失败时各框仍然按时间对齐，缺失的帧为 0
+class TensorOutput : public CropOutput {
+    struct Clip {
+        int fd;
+        uint8_t *map;
+        size_t size;
+    };
+
+    struct Lane {
+        int64_t next = 0;       // 下一个时间步序号（已写入的最大序号 + 1），在 __lock 中修改
+        SwsContext *sws = nullptr;
+        std::vector<uint8_t> tmp;   // f32 时 sws 的输出
+    };
+
+    TensorConfig __cfg;
+    std::string __prefix;
+    std::vector<Box> __boxes;
+    int __w = 0, __h = 0;
+    size_t __data_offset = 0;
+    size_t __plane = 0;         // 每个通道的字节数
+    double __fps = 25;
+    double __origin = -1.0;     // 时间步 0 的时间戳
+
+    std::mutex __lock;
+    std::map<int, Clip> __clips;
+    std::vector<Lane> __lanes;
+
+public:
+    // fps: 输出帧率，用于由时间戳计算帧序号
+    int open(const std::vector<Box> &boxes, const char *prefix, int width, int height, double fps,
+            const TensorConfig &cfg);
+
+    int lanes() const override { return __lanes.size(); }
+    int lane(int box) const override { return box; }
+
+    int put_frame(int box, double stamp, AVFrame *frame) override;
+    int close() override;
+    void set_origin(double stamp) override;
+
+private:
+    Clip *__get_clip(int idx);
+    void __finish_clip(int idx, Clip &clip, int frames);
+    void __finish_ready();
+    void __convert(Lane &lane, AVFrame *frame, uint8_t *dst);
+};
+
+#endif // tensor.hxx
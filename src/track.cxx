@@ -0,0 +1,274 @@
+#include "track.hxx"
+#include "media.hxx"
+
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <map>
+
+static const char _magic[4] = { 'B', 'T', 'R', 'K' };
+
+const char *cls_title(int cls) {
+    static const char *_title[] = {
+        "standup", "writing", "reading", "raise_hand", "wait", "sitback",
+        "p_screen", "p_bb", "write_bb", "head", "head_table", "face_raise",
+        "back_standup",
+    };
+    if (cls < 0 || cls >= sizeof(_title) / sizeof(_title[0])) {
+        return "none";
+    }
+    return _title[cls];
+}
+
+TrackSet::~TrackSet() {
+    close();
+}
+
+void TrackSet::close() {
+    if (__map) {
+        munmap(__map, __map_size);
+        __map = nullptr;
+        __map_size = 0;
+    }
+    __tracks.clear();
+    __keys.clear();
+}
+
+void TrackSet::set_ext(double left, double right, double top) {
+    __ext_left = left;
+    __ext_right = right;
+    __ext_top = top;
+}
+
+int TrackSet::load(const char *fname) {
+    close();
+
+    FILE *fp = fopen(fname, "rb");
+    if (!fp) {
+        fprintf(stderr, "ERR: %s:%d cannot open track file: %s\n", __func__, __LINE__, fname);
+        return -1;
+    }
+    char magic[4];
+    bool binary = fread(magic, 4, 1, fp) == 1 && memcmp(magic, _magic, 4) == 0;
+    fclose(fp);
+
+    int rc = binary ? __load_binary(fname) : __load_text(fname);
+    if (rc < 0) {
+        close();
+        return rc;
+    }
+    if (__tracks.empty()) {
+        fprintf(stderr, "WARN: %s:%d no track in %s\n", __func__, __LINE__, fname);
+    }
+    return 0;
+}
+
+int TrackSet::__load_binary(const char *fname) {
+    int fd = open(fname, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "ERR: %s:%d cannot open track file: %s\n", __func__, __LINE__, fname);
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0 || st.st_size < sizeof(TrackFileHeader)) {
+        fprintf(stderr, "ERR: %s:%d invalid track file: %s\n", __func__, __LINE__, fname);
+        ::close(fd);
+        return -1;
+    }
+
+    __map_size = st.st_size;
+    __map = mmap(0, __map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (__map == MAP_FAILED) {
+        fprintf(stderr, "ERR: %s:%d mmap %s failed\n", __func__, __LINE__, fname);
+        __map = nullptr;
+        return -1;
+    }
+    // 播放时顺序访问
+    madvise(__map, __map_size, MADV_SEQUENTIAL);
+
+    // 先按文件大小限制个数，再计算需要的大小，避免乘法溢出
+    const TrackFileHeader *head = (const TrackFileHeader *)__map;
+    size_t body = __map_size - sizeof(TrackFileHeader);
+    bool fits = head->track_cnt <= body / sizeof(TrackFileEntry) && head->key_cnt <= body / sizeof(TrackKey) &&
+        head->track_cnt * sizeof(TrackFileEntry) + head->key_cnt * sizeof(TrackKey) <= body;
+    if (head->version != 1 || !fits) {
+        fprintf(stderr, "ERR: %s:%d invalid track file: %s, version=%u\n", __func__, __LINE__,
+                fname, head->version);
+        return -1;
+    }
+
+    const TrackFileEntry *entries = (const TrackFileEntry *)(head + 1);
+    const TrackKey *keys = (const TrackKey *)(entries + head->track_cnt);
+    for (uint32_t i = 0; i < head->track_cnt; i++) {
+        const TrackFileEntry &e = entries[i];
+        if (e.count == 0 || e.count > head->key_cnt || e.first > head->key_cnt - e.count) {
+            fprintf(stderr, "WARN: %s:%d invalid track #%u in %s\n", __func__, __LINE__, i, fname);
+            continue;
+        }
+        // 插值按时间二分查找，key 必须按 stamp 递增
+        const TrackKey *k = keys + e.first;
+        uint64_t j = 1;
+        while (j < e.count && k[j].stamp >= k[j-1].stamp) j++;
+        if (j < e.count || !(k[0].stamp == k[0].stamp)) {
+            fprintf(stderr, "WARN: %s:%d track #%u in %s: stamps not ascending at key #%llu\n", __func__, __LINE__,
+                    i, fname, (unsigned long long)j);
+            continue;
+        }
+        __tracks.push_back({ e.cls, e.score, keys + e.first, (size_t)e.count, 0 });
+    }
+    return 0;
+}
+
+int TrackSet::__load_text(const char *fname) {
+    FILE *fp = fopen(fname, "r");
+    if (!fp) {
+        fprintf(stderr, "ERR: %s:%d cannot open track file: %s\n", __func__, __LINE__, fname);
+        return -1;
+    }
+
+    // 按首次出现的顺序保存轨迹
+    struct Text {
+        int cls;
+        double score;
+        std::vector<TrackKey> keys;
+    };
+    std::vector<Text> tracks;
+    std::map<int, size_t> ids;
+    char line[512];
+    int n = 0;
+    while (fgets(line, sizeof(line), fp)) {
+        int id, cls;
+        double stamp, score;
+        float x1, y1, x2, y2;
+        if (sscanf(line, "%d %lf %f %f %f %f %lf %d", &id, &stamp, &x1, &y1, &x2, &y2, &score, &cls) == 8) {
+            // 轨迹格式
+        }
+        else if (sscanf(line, "%f %f %f %f %lf %d", &x1, &y1, &x2, &y2, &score, &cls) == 6) {
+            // 固定框，每行一条轨迹
+            id = -1 - n;
+            stamp = 0.0;
+        }
+        else {
+            continue;
+        }
+        n++;
+        if (x2 <= x1 || y2 <= y1) {
+            fprintf(stderr, "WARN: %s:%d invalid box: %.0f,%.0f,%.0f,%.0f\n", __func__, __LINE__,
+                    x1, y1, x2, y2);
+            continue;
+        }
+
+        auto it = ids.find(id);
+        if (it == ids.end()) {
+            it = ids.insert({ id, tracks.size() }).first;
+            tracks.push_back({ cls, score, {} });
+        }
+        tracks[it->second].keys.push_back({ stamp, x1, y1, x2, y2 });
+    }
+    fclose(fp);
+
+    size_t total = 0;
+    for (auto &t: tracks) {
+        total += t.keys.size();
+    }
+    __keys.reserve(total);
+    for (auto &t: tracks) {
+        std::stable_sort(t.keys.begin(), t.keys.end(), [](const TrackKey &a, const TrackKey &b) {
+            return a.stamp < b.stamp;
+        });
+        __tracks.push_back({ t.cls, t.score, __keys.data() + __keys.size(), t.keys.size(), 0 });
+        __keys.insert(__keys.end(), t.keys.begin(), t.keys.end());
+    }
+    return 0;
+}
+
+int TrackSet::save(const char *fname) const {
+    FILE *fp = fopen(fname, "wb");
+    if (!fp) {
+        fprintf(stderr, "ERR: %s:%d cannot write track file: %s\n", __func__, __LINE__, fname);
+        return -1;
+    }
+
+    TrackFileHeader head;
+    memcpy(head.magic, _magic, 4);
+    head.version = 1;
+    head.track_cnt = __tracks.size();
+    head.reserved = 0;
+    head.key_cnt = 0;
+    for (auto &t: __tracks) {
+        head.key_cnt += t.cnt;
+    }
+    fwrite(&head, sizeof(head), 1, fp);
+
+    uint64_t first = 0;
+    for (auto &t: __tracks) {
+        TrackFileEntry e = { t.cls, (float)t.score, first, t.cnt };
+        fwrite(&e, sizeof(e), 1, fp);
+        first += t.cnt;
+    }
+    bool ok = true;
+    for (auto &t: __tracks) {
+        ok = ok && fwrite(t.keys, sizeof(TrackKey), t.cnt, fp) == t.cnt;
+    }
+    fclose(fp);
+
+    if (!ok) {
+        fprintf(stderr, "ERR: %s:%d write track file %s failed\n", __func__, __LINE__, fname);
+        return -1;
+    }
+    return 0;
+}
+
+void TrackSet::__interp(Track &t, double stamp, float *x1, float *y1, float *x2, float *y2) {
+    const TrackKey *keys = t.keys;
+    if (t.cnt == 1 || stamp <= keys[0].stamp) {
+        *x1 = keys[0].x1; *y1 = keys[0].y1; *x2 = keys[0].x2; *y2 = keys[0].y2;
+        return;
+    }
+    const TrackKey &last = keys[t.cnt - 1];
+    if (stamp >= last.stamp) {
+        *x1 = last.x1; *y1 = last.y1; *x2 = last.x2; *y2 = last.y2;
+        return;
+    }
+
+    // 找到 keys[i].stamp <= stamp < keys[i+1].stamp
+    size_t i = t.cursor < t.cnt - 1 ? t.cursor : 0;
+    if (keys[i].stamp > stamp) {
+        i = std::upper_bound(keys, keys + t.cnt, stamp, [](double v, const TrackKey &k) {
+            return v < k.stamp;
+        }) - keys - 1;
+    }
+    while (keys[i+1].stamp <= stamp)
+        i++;
+    t.cursor = i;
+
+    const TrackKey &a = keys[i], &b = keys[i+1];
+    float r = (float)((stamp - a.stamp) / (b.stamp - a.stamp));
+    *x1 = a.x1 + (b.x1 - a.x1) * r;
+    *y1 = a.y1 + (b.y1 - a.y1) * r;
+    *x2 = a.x2 + (b.x2 - a.x2) * r;
+    *y2 = a.y2 + (b.y2 - a.y2) * r;
+}
+
+void TrackSet::at(double stamp, std::vector<Box> &boxes) {
+    boxes.resize(__tracks.size());
+    for (size_t i = 0; i < __tracks.size(); i++) {
+        Track &t = __tracks[i];
+        float x1, y1, x2, y2;
+        __interp(t, stamp, &x1, &y1, &x2, &y2);
+
+        float w = x2 - x1, h = y2 - y1;
+        Box &box = boxes[i];
+        box.x1 = (int)(x1 - w * __ext_left);
+        box.x2 = (int)(x2 + w * __ext_right);
+        box.y1 = (int)(y1 - h * __ext_top);
+        box.y2 = (int)y2;
+        box.title = cls_title(t.cls);
+        box.score = t.score;
+    }
+}
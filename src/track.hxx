@@ -0,0 +1,80 @@
+#ifndef _box_track_hh
+#define _box_track_hh
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+class Box;
+
+/// 框的类别名字，cls 越界返回 "none"
+const char *cls_title(int cls);
+
+/// 轨迹关键帧
+struct TrackKey {
+    double stamp;           // 秒
+    float x1, y1, x2, y2;
+};
+
+/// 二进制轨迹文件 (.trk) 布局，小端:
+///     TrackFileHeader
+///     TrackFileEntry[track_cnt]
+///     TrackKey[key_cnt]      每条轨迹的 key 连续存放并按 stamp 递增
+struct TrackFileHeader {
+    char magic[4];          // "BTRK"
+    uint32_t version;
+    uint32_t track_cnt;
+    uint32_t reserved;
+    uint64_t key_cnt;
+};
+
+struct TrackFileEntry {
+    int32_t cls;
+    float score;
+    uint64_t first;         // 第一个 key 的序号
+    uint64_t count;
+};
+
+/// 随时间变化的框轨迹，关键帧之间线性插值
+/// 支持三种输入:
+///     二进制 .trk，mmap 后直接使用，不解析
+///     文本，每行 id stamp x1 y1 x2 y2 score cls，相同 id 为一条轨迹
+///     文本，每行 x1 y1 x2 y2 score cls，即原来的 act_box.txt，每个框为固定轨迹
+class TrackSet {
+    struct Track {
+        int cls;
+        double score;
+        const TrackKey *keys;
+        size_t cnt;
+        size_t cursor;      // 上次查找的位置，时间戳递增时 O(1)
+    };
+    std::vector<Track> __tracks;
+    std::vector<TrackKey> __keys;   // 文本格式的数据
+
+    void *__map = nullptr;
+    size_t __map_size = 0;
+
+    double __ext_left = 0.0, __ext_right = 0.0, __ext_top = 0.0;
+
+public:
+    ~TrackSet();
+
+    int load(const char *fname);
+    int save(const char *fname) const;
+    void close();
+
+    // 与 load_boxes_from_file 相同的扩展比例
+    void set_ext(double left, double right, double top);
+
+    size_t size() const { return __tracks.size(); }
+
+    // 得到 stamp 时刻每条轨迹的框，boxes 大小与轨迹数相同
+    void at(double stamp, std::vector<Box> &boxes);
+
+private:
+    int __load_binary(const char *fname);
+    int __load_text(const char *fname);
+    static void __interp(Track &track, double stamp, float *x1, float *y1, float *x2, float *y2);
+};
+
+#endif // track.hxx
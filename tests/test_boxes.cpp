@@ -0,0 +1,83 @@
+// 框后处理: 默认参数下几乎相同、类别不同的框不被 nms 去掉，共用 crop 区域；类别相同的重复框去掉
+#include "job.hxx"
+#include "boxes.hxx"
+
+#include <stdio.h>
+#include <string.h>
+
+static int _failed = 0;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        fprintf(stderr, "ERR: %s:%d check failed: %s\n", __func__, __LINE__, #cond); \
+        _failed++; \
+    } \
+} while (0)
+
+static void test_share_with_defaults() {
+    Opts opts;
+    init_opts(&opts);
+
+    std::vector<Box> boxes = {
+        { 100, 100, 300, 400, "person", 0.9 },
+        { 102, 101, 301, 402, "reading", 0.8 },    // 与第一个 IoU > 0.9、类别不同，共用 crop
+        { 100, 100, 300, 330, "person", 0.7 },     // 与第一个 IoU 约 0.77，nms 去掉
+        { 500, 100, 700, 400, "person", 0.6 },
+    };
+    CHECK(box_iou(boxes[0], boxes[1]) >= opts.share_iou);
+    CHECK(box_iou(boxes[0], boxes[2]) > opts.nms_iou && box_iou(boxes[0], boxes[2]) < opts.share_iou);
+
+    boxes = nms_boxes(boxes, opts.nms_iou, opts.max_person_cnt, opts.share_iou);
+    CHECK(boxes.size() == 3);
+
+    std::vector<Box> regions;
+    std::vector<int> region_of = share_regions(boxes, opts.share_iou, regions);
+    CHECK(regions.size() == 2);
+    CHECK(region_of == std::vector<int>({ 0, 0, 1 }));
+}
+
+static void test_nms_disabled() {
+    std::vector<Box> boxes = {
+        { 100, 100, 300, 400, "person", 0.9 },
+        { 100, 100, 300, 400, "person", 0.8 },
+    };
+    CHECK(nms_boxes(boxes, 0, 0).size() == 2);
+    CHECK(nms_boxes(boxes, 0.7f, 0).size() == 1);
+    // 类别相同的完全重复框只保留一个，否则两个编码器写同一个文件
+    CHECK(nms_boxes(boxes, 0.7f, 0, 0.9f).size() == 1);
+}
+
+static void test_identical_boxes() {
+    Opts opts;
+    init_opts(&opts);
+
+    // 裁剪到图像内之后变得完全相同
+    std::vector<Box> boxes = {
+        { -50, 100, 300, 400, "person", 0.9 },
+        { -20, 100, 300, 400, "person", 0.8 },
+        { 0, 100, 300, 400, "reading", 0.7 },
+    };
+    boxes = clamp_boxes(boxes, 640, 480);
+    CHECK(boxes.size() == 3);
+    boxes = nms_boxes(boxes, opts.nms_iou, opts.max_person_cnt, opts.share_iou);
+    CHECK(boxes.size() == 2);
+    CHECK(boxes.size() == 2 && strcmp(boxes[0].title, "person") == 0 && boxes[0].score > 0.85);
+    CHECK(boxes.size() == 2 && strcmp(boxes[1].title, "reading") == 0);
+
+    // 不同类别的框共用一次 crop
+    std::vector<Box> regions;
+    share_regions(boxes, opts.share_iou, regions);
+    CHECK(regions.size() == 1);
+}
+
+int main() {
+    test_share_with_defaults();
+    test_nms_disabled();
+    test_identical_boxes();
+    if (_failed) {
+        fprintf(stderr, "%d checks failed\n", _failed);
+        return 1;
+    }
+    fprintf(stdout, "all passed\n");
+    return 0;
+}
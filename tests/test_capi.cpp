@@ -0,0 +1,91 @@
+// C 接口: 参数、框设置、错误返回值，默认不向 stdout 输出过程信息
+#include "cropvid.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+static int _failed = 0;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        fprintf(stderr, "ERR: %s:%d check failed: %s\n", __func__, __LINE__, #cond); \
+        _failed++; \
+    } \
+} while (0)
+
+static int on_packet(void *opaque, const cropvid_packet *pkt) {
+    (*(int *)opaque)++;
+    return 0;
+}
+
+static void test_params() {
+    CHECK(strcmp(cropvid_version(), CROPVID_VERSION) == 0);
+
+    cropvid_params p;
+    memset(&p, 0xff, sizeof(p));
+    cropvid_default_params(&p);
+    CHECK(p.width == 320 && p.height == 240);
+    CHECK(p.from == 0.0 && p.duration > 0);
+    CHECK(p.threads == 0 && p.debug == 0);
+}
+
+static void test_open_errors() {
+    CHECK(cropvid_open_memory(nullptr, 0, nullptr) == nullptr);
+    CHECK(cropvid_open_io(nullptr, nullptr, nullptr, nullptr) == nullptr);
+    CHECK(cropvid_open_file("/nonexistent/input.mp4", nullptr) == nullptr);
+    CHECK(cropvid_open_mapped("/nonexistent/input.mp4", nullptr) == nullptr);
+    cropvid_close(nullptr);
+}
+
+static void test_boxes_and_run() {
+    static const uint8_t data[4096] = { 0 };
+    cropvid_t *h = cropvid_open_memory(data, sizeof(data), nullptr);
+    CHECK(h != nullptr);
+    if (!h) return;
+
+    // 没有回调
+    CHECK(cropvid_run(h) < 0);
+
+    int packets = 0;
+    CHECK(cropvid_set_packet_callback(h, on_packet, &packets) == 0);
+    // 没有框
+    CHECK(cropvid_run(h) == 1);
+
+    cropvid_box boxes[] = {
+        { 100, 100, 300, 400, 0, 0.9 },
+        { 300, 100, 200, 400, 0, 0.8 },     // x2 < x1，忽略
+        { 500, 100, 700, 400, 0, 0.7 },
+    };
+    CHECK(cropvid_set_boxes(h, boxes, 3) == 2);
+
+    // 输入不是视频: 失败，不输出 packet，也不向 stdout 输出过程信息
+    fflush(stdout);
+    FILE *tmp = tmpfile();
+    int saved = dup(1);
+    dup2(fileno(tmp), 1);
+    int rc = cropvid_run(h);
+    fflush(stdout);
+    dup2(saved, 1);
+    close(saved);
+    CHECK(rc < 0);
+    CHECK(packets == 0);
+    CHECK(fseek(tmp, 0, SEEK_END) == 0 && ftell(tmp) == 0);
+    fclose(tmp);
+
+    const cropvid_box *out = nullptr;
+    CHECK(cropvid_output_boxes(h, &out) == 0 && out == nullptr);
+    cropvid_close(h);
+}
+
+int main() {
+    test_params();
+    test_open_errors();
+    test_boxes_and_run();
+    if (_failed) {
+        fprintf(stderr, "%d checks failed\n", _failed);
+        return 1;
+    }
+    fprintf(stdout, "all passed\n");
+    return 0;
+}
@@ -0,0 +1,81 @@
+// 拼图: 某一时刻没有 crop 结果的框，格子为黑色而不是上一帧的内容
+#include "mosaic.hxx"
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <string>
+
+static int _failed = 0;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        fprintf(stderr, "ERR: %s:%d check failed: %s\n", __func__, __LINE__, #cond); \
+        _failed++; \
+    } \
+} while (0)
+
+static AVFrame *gray_frame(int w, int h, int y) {
+    AVFrame *f = av_frame_alloc();
+    f->width = w;
+    f->height = h;
+    f->format = AV_PIX_FMT_YUV420P;
+    if (av_frame_get_buffer(f, 0) < 0) {
+        av_frame_free(&f);
+        return nullptr;
+    }
+    for (int r = 0; r < h; r++) {
+        memset(f->data[0] + r * f->linesize[0], y, w);
+    }
+    for (int r = 0; r < h / 2; r++) {
+        memset(f->data[1] + r * f->linesize[1], 128, w / 2);
+        memset(f->data[2] + r * f->linesize[2], 128, w / 2);
+    }
+    return f;
+}
+
+// 格子左上角的亮度
+static int tile_luma(const MosaicOutput &m, int x, int y) {
+    const AVFrame *c = m.canvas();
+    return c->data[0][y * c->linesize[0] + x];
+}
+
+static void test_missing_crop_is_black() {
+    const int w = 64, h = 48;
+    const char *fname = "test_mosaic.mp4";
+    std::vector<Box> boxes = {
+        { 0, 0, 100, 100, "person", 0.9 },
+        { 200, 0, 300, 100, "person", 0.8 },
+    };
+    MosaicOutput m;
+    CHECK(m.open(boxes, fname, w, h, 25, 2) == 0);
+    AVFrame *white = gray_frame(w, h, 235);
+    CHECK(white != nullptr);
+    if (!m.canvas() || !white) return;
+
+    // 第一帧两个框都有
+    CHECK(m.put_frame(0, 0.00, white) == 0);
+    CHECK(m.put_frame(1, 0.00, white) == 0);
+    CHECK(tile_luma(m, w, 0) == 235);
+
+    // 第二帧框 1 crop 失败，不调用 put_frame；下一时刻到达时编码第二帧
+    CHECK(m.put_frame(0, 0.04, white) == 0);
+    CHECK(m.put_frame(0, 0.08, white) == 0);
+    CHECK(tile_luma(m, w, 0) == 16);
+    CHECK(tile_luma(m, 0, 0) == 235);
+
+    m.close();
+    av_frame_free(&white);
+    unlink(fname);
+    unlink((std::string(fname) + ".tiles").c_str());
+}
+
+int main() {
+    test_missing_crop_is_black();
+    if (_failed) {
+        fprintf(stderr, "%d checks failed\n", _failed);
+        return 1;
+    }
+    fprintf(stdout, "all passed\n");
+    return 0;
+}
@@ -0,0 +1,108 @@
+// crop_vid -shm 的参考读端
+// crop_vid_shm_reader name [-n max_frames] [-dump prefix] [-t timeout_ms]
+//   逐帧打印: seq box stamp Y 平面校验和，-dump 时每个框追加写 <prefix>-<box>.yuv (yuv420p)
+
+#include "shm.hxx"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <map>
+#include <string>
+#include <vector>
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s name [-n max_frames] [-dump prefix] [-t timeout_ms]\n", argv[0]);
+        return -1;
+    }
+
+    const char *name = argv[1];
+    long max_frames = -1;
+    const char *dump = 0;
+    int timeout = 5000;
+    for (int curr = 2; curr + 1 < argc; curr += 2) {
+        if (strcmp(argv[curr], "-n") == 0) {
+            max_frames = atol(argv[curr+1]);
+        }
+        else if (strcmp(argv[curr], "-dump") == 0) {
+            dump = argv[curr+1];
+        }
+        else if (strcmp(argv[curr], "-t") == 0) {
+            timeout = atoi(argv[curr+1]);
+        }
+        else {
+            fprintf(stderr, "ERR: %s:%d unknown opt: %s\n", __func__, __LINE__, argv[curr]);
+            return -1;
+        }
+    }
+
+    ShmReader reader;
+    if (reader.open(name, timeout) < 0) {
+        return -1;
+    }
+    const ShmRingHeader *head = reader.header();
+    fprintf(stderr, "shm %s: %u x %u, %u boxes, %u slots, block %u\n",
+            name, head->width, head->height, head->boxes, head->slots, head->block);
+
+    std::map<int, FILE *> files;
+    std::vector<uint8_t> buf;
+    long cnt = 0, bad = 0;
+    ShmFrame frame;
+    while (max_frames < 0 || cnt < max_frames) {
+        int rc = reader.next(&frame, timeout);
+        if (rc == 0) {
+            fprintf(stderr, "WARN: %s:%d timeout\n", __func__, __LINE__);
+            continue;
+        }
+        if (rc < 0) {
+            break;  // 写端已结束
+        }
+
+        uint32_t sum = 0;
+        for (int r = 0; r < frame.height; r++) {
+            const uint8_t *p = frame.data[0] + r * frame.linesize[0];
+            for (int c = 0; c < frame.width; c++) {
+                sum += p[c];
+            }
+        }
+
+        // -dump 先复制出来，确认没有被覆盖后才写文件
+        if (dump) {
+            buf.clear();
+            for (int p = 0; p < 3; p++) {
+                int w = p ? (frame.width + 1) / 2 : frame.width, h = p ? (frame.height + 1) / 2 : frame.height;
+                for (int r = 0; r < h; r++) {
+                    const uint8_t *row = frame.data[p] + r * frame.linesize[p];
+                    buf.insert(buf.end(), row, row + w);
+                }
+            }
+        }
+
+        // 处理期间被写端覆盖
+        if (!reader.valid(frame)) {
+            bad++;
+            continue;
+        }
+
+        if (dump) {
+            FILE *&fp = files[frame.box];
+            if (!fp) {
+                std::string fname = std::string(dump) + "-" + std::to_string(frame.box) + ".yuv";
+                fp = fopen(fname.c_str(), "wb");
+            }
+            if (fp) {
+                fwrite(buf.data(), 1, buf.size(), fp);
+            }
+        }
+        fprintf(stdout, "%llu %d %.03f %u\n", (unsigned long long)frame.seq, frame.box, frame.stamp, sum);
+        cnt++;
+    }
+
+    for (auto &f: files) {
+        if (f.second) fclose(f.second);
+    }
+    fprintf(stderr, "frames: %ld, lost: %llu, overwritten: %ld\n", cnt, (unsigned long long)reader.lost(), bad);
+    reader.close();
+    return 0;
+}